@@ -0,0 +1,445 @@
+/// Rendering benchmark for QPaintGrid.
+/// Records the redraw events Neovim sends for a scripted editing session
+/// into a corpus file, and replays the corpus through EditorBase and
+/// QPaintGrid::process_events without a display, rendering every frame
+/// into a QImage.
+///
+/// Record a corpus (needs nvim in PATH):
+///   nvui_bench --record=corpus.bin --file=src/qpaintgrid.cpp
+/// Replay the corpus (doesn't need nvim):
+///   nvui_bench --replay=corpus.bin [--dump-frames=dir]
+/// To measure ligature shaping, record a ligature-heavy file with a
+/// ligature font and replay it with and without --ligatures:
+///   nvui_bench --record=lig.bin --file=app.hs --guifont="Fira Code:h11"
+///   nvui_bench --replay=lig.bin --ligatures
+/// To measure completion popup paint time while typing, type the
+/// identifiers of a file and show a popup of matching words on every
+/// keystroke (no corpus or nvim needed):
+///   nvui_bench --popup --file=src/qpaintgrid.cpp
+/// To measure client-side fuzzy filtering (:NvuiPopupMenuFuzzy),
+/// filter a generated list of completion items on every keystroke:
+///   nvui_bench --fuzzy [--items=20000]
+/// QT_QPA_PLATFORM defaults to "offscreen" so this can run on machines
+/// without a GPU or a display server.
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include "fuzzy.hpp"
+#include "nvim.hpp"
+#include "object.hpp"
+#include "qeditor.hpp"
+#include "qpaintgrid.hpp"
+
+using namespace std::chrono_literals;
+
+static std::optional<std::string> get_arg(
+  const std::vector<std::string>& args,
+  std::string_view prefix
+)
+{
+  for(const auto& arg : args)
+  {
+    if (arg.rfind(prefix, 0) == 0) return arg.substr(prefix.size());
+  }
+  return std::nullopt;
+}
+
+/// Exposes the parts of QEditor the benchmark needs to drive it
+/// without attaching to Neovim. Built on a detached Nvim, so no
+/// Neovim process is started.
+class ReplayEditor : public QEditor
+{
+public:
+  using QEditor::QEditor;
+  using EditorBase::handle_redraw;
+  using EditorBase::screen_resized;
+  const auto& grid_list() const { return grids; }
+};
+
+static bool contains_flush(const Object& redraw)
+{
+  const auto* events = redraw.try_at(2).array();
+  if (!events) return false;
+  for(const auto& event : *events)
+  {
+    const auto* name = event.try_at(0).string();
+    if (name && *name == "flush") return true;
+  }
+  return false;
+}
+
+static int record(
+  const std::string& corpus_path,
+  const std::string& file,
+  const std::optional<std::string>& guifont
+)
+{
+  constexpr int cols = 200;
+  constexpr int rows = 60;
+  std::ofstream out {corpus_path, std::ios::binary};
+  if (!out)
+  {
+    fmt::print("Could not open '{}' for writing.\n", corpus_path);
+    return 1;
+  }
+  std::mutex out_mutex;
+  std::atomic<std::size_t> batches = 0;
+  Nvim nvim {"", {"--embed", "--clean"}};
+  nvim.set_notification_handler("redraw", [&](Object msg) {
+    msgpack::sbuffer sbuf;
+    msgpack::packer<msgpack::sbuffer> packer {sbuf};
+    msg.to_msgpack(packer);
+    std::lock_guard<std::mutex> lock {out_mutex};
+    out.write(sbuf.data(), static_cast<std::streamsize>(sbuf.size()));
+    ++batches;
+  });
+  nvim.attach_ui(cols, rows, {{"ext_linegrid", true}});
+  std::vector<std::string> script {
+    fmt::format(":edit {}<CR>", file),
+    ":syntax on<CR>",
+    ":set number cursorline<CR>"
+  };
+  if (guifont)
+  {
+    std::string escaped;
+    for(char c : *guifont)
+    {
+      if (c == ' ') escaped += '\\';
+      escaped += c;
+    }
+    script.push_back(fmt::format(":set guifont={}<CR>", escaped));
+  }
+  const auto repeat = [&](const std::string& keys, int times) {
+    for(int i = 0; i < times; ++i) script.push_back(keys);
+  };
+  repeat("<C-d>", 30);
+  repeat("<C-u>", 30);
+  repeat("j", 60);
+  script.push_back("G");
+  script.push_back("gg");
+  script.push_back(":set background=light<CR>");
+  script.push_back(":vsplit<CR>");
+  repeat("<C-d>", 20);
+  script.push_back(":set background=dark<CR>");
+  repeat("<C-e>", 60);
+  for(const auto& keys : script)
+  {
+    nvim.send_input(keys);
+    std::this_thread::sleep_for(30ms);
+  }
+  std::this_thread::sleep_for(500ms);
+  std::lock_guard<std::mutex> lock {out_mutex};
+  fmt::print("Recorded {} redraw batches to '{}'.\n", batches.load(), corpus_path);
+  return 0;
+}
+
+static double percentile(std::vector<double> v, double pct)
+{
+  if (v.empty()) return 0.;
+  std::sort(v.begin(), v.end());
+  auto idx = static_cast<std::size_t>(pct / 100. * double(v.size() - 1));
+  return v[idx];
+}
+
+static int replay(
+  const std::string& corpus_path,
+  const std::optional<std::string>& dump_dir,
+  bool ligatures
+)
+{
+  std::ifstream in {corpus_path, std::ios::binary};
+  if (!in)
+  {
+    fmt::print("Could not open '{}'.\n", corpus_path);
+    return 1;
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  const std::string corpus = ss.str();
+  if (dump_dir) QDir().mkpath(QString::fromStdString(*dump_dir));
+  ReplayEditor editor {200, 60, {}, std::string(Nvim::detached_path), {}};
+  editor.setup();
+  editor.set_ligatures_enabled(ligatures);
+  FontDimensions dims {0, 0};
+  const auto fit_editor = [&] {
+    auto cur = editor.font_dimensions();
+    if (cur.width == dims.width && cur.height == dims.height) return;
+    dims = cur;
+    auto* grid = editor.grid_list().empty()
+      ? nullptr : editor.grid_list().front().get();
+    int cols = grid ? grid->cols : 200;
+    int rows = grid ? grid->rows : 60;
+    editor.resize(int(cols * dims.width), int(rows * dims.height));
+    editor.screen_resized(editor.width(), editor.height());
+  };
+  std::vector<double> frame_times;
+  double state_changes = 0;
+  QImage frame;
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  std::size_t offset = 0;
+  std::size_t batches = 0;
+  while(offset < corpus.size())
+  {
+    Object batch = Object::from_msgpack(corpus, offset);
+    if (batch.is_err()) break;
+    const bool is_frame = contains_flush(batch);
+    editor.handle_redraw(std::move(batch));
+    ++batches;
+    fit_editor();
+    if (!is_frame) continue;
+    if (frame.size() != editor.size())
+    {
+      frame = QImage(editor.size(), QImage::Format_ARGB32_Premultiplied);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const auto before = editor.shared_fonts().caches.text.stats();
+    for(const auto& grid_base : editor.grid_list())
+    {
+      auto* grid = static_cast<QPaintGrid*>(grid_base.get());
+      if (grid->hidden) continue;
+      const auto changes_before = grid->state_changes();
+      grid->process_events();
+      state_changes += double(grid->state_changes() - changes_before);
+    }
+    const auto& after = editor.shared_fonts().caches.text.stats();
+    hits += after.hits - before.hits;
+    misses += after.misses - before.misses;
+    QPainter p(&frame);
+    editor.draw_frame(p);
+    p.end();
+    frame_times.push_back(double(timer.nsecsElapsed()) / 1e6);
+    if (dump_dir)
+    {
+      frame.save(QString("%1/frame_%2.png")
+        .arg(QString::fromStdString(*dump_dir))
+        .arg(frame_times.size(), 5, 10, QChar('0'))
+      );
+    }
+  }
+  double total_ms = 0;
+  for(const auto& t : frame_times) total_ms += t;
+  const auto lookups = hits + misses;
+  fmt::print("Shaping:          {}\n", ligatures ? "clusters" : "runs");
+  fmt::print("Batches replayed: {}\n", batches);
+  fmt::print("Frames rendered:  {}\n", frame_times.size());
+  fmt::print("Frames/sec:       {:.1f}\n",
+    total_ms > 0 ? double(frame_times.size()) * 1000. / total_ms : 0.);
+  fmt::print("Frame time p50:   {:.3f} ms\n", percentile(frame_times, 50));
+  fmt::print("Frame time p99:   {:.3f} ms\n", percentile(frame_times, 99));
+  fmt::print("State changes:    {:.1f} per frame\n",
+    frame_times.empty() ? 0. : state_changes / double(frame_times.size()));
+  fmt::print("Text cache hits:  {:.1f}% ({} / {})\n",
+    lookups ? 100. * double(hits) / double(lookups) : 0., hits, lookups);
+  return 0;
+}
+
+static Object redraw_batch(ObjectArray events)
+{
+  return ObjectArray {std::int64_t(2), std::string("redraw"), std::move(events)};
+}
+
+/// Simulates typing the identifiers of a file with completion on:
+/// every keystroke shows the words starting with what was typed so far
+/// and selects a few of them.
+static int popup(const std::string& file)
+{
+  std::ifstream in {file};
+  if (!in)
+  {
+    fmt::print("Could not open '{}'.\n", file);
+    return 1;
+  }
+  std::set<std::string> vocabulary;
+  std::string word;
+  char c;
+  const auto is_ident = [](char ch) {
+    return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+  };
+  while(in.get(c))
+  {
+    if (is_ident(c)) { word += c; continue; }
+    if (word.size() >= 3) vocabulary.insert(word);
+    word.clear();
+  }
+  if (word.size() >= 3) vocabulary.insert(word);
+  std::vector<std::string> typed;
+  int n = 0;
+  for(const auto& w : vocabulary)
+  {
+    if (n++ % 7 == 0 && w.size() >= 4) typed.push_back(w);
+    if (typed.size() == 40) break;
+  }
+  constexpr std::size_t max_items = 200;
+  ReplayEditor editor {200, 60, {}, std::string(Nvim::detached_path), {}};
+  editor.setup();
+  editor.resize(1600, 1000);
+  std::vector<double> show_times;
+  std::vector<double> select_times;
+  const auto timed = [&](std::vector<double>& times, ObjectArray events) {
+    QElapsedTimer timer;
+    timer.start();
+    editor.handle_redraw(redraw_batch(std::move(events)));
+    times.push_back(double(timer.nsecsElapsed()) / 1e6);
+  };
+  const auto select_event = [](int index) {
+    return ObjectArray {
+      std::string("popupmenu_select"), ObjectArray {std::int64_t(index)}
+    };
+  };
+  for(const auto& target : typed)
+  {
+    for(std::size_t len = 1; len <= target.size(); ++len)
+    {
+      const std::string_view prefix {target.data(), len};
+      ObjectArray items;
+      for(auto it = vocabulary.lower_bound(std::string(prefix));
+        it != vocabulary.end() && it->starts_with(prefix)
+        && items.size() < max_items; ++it)
+      {
+        items.push_back(ObjectArray {
+          *it, std::string("Function"), std::string(), std::string()
+        });
+      }
+      ObjectArray show {
+        std::string("popupmenu_show"),
+        ObjectArray {
+          std::move(items), std::int64_t(-1), std::int64_t(1),
+          std::int64_t(len), std::int64_t(1)
+        }
+      };
+      timed(show_times, {std::move(show)});
+      for(int i = 0; i < 3; ++i) timed(select_times, {select_event(i)});
+    }
+    editor.handle_redraw(redraw_batch({
+      ObjectArray {std::string("popupmenu_hide"), ObjectArray {}}
+    }));
+  }
+  const auto stats = editor.render_stats();
+  const auto stat = [&](const char* name) {
+    auto it = stats.find(name);
+    return it == stats.end() ? 0. : it->second;
+  };
+  const double hits = stat("popup_text_cache_hits");
+  const double lookups = hits + stat("popup_text_cache_misses");
+  fmt::print("Words typed:      {} ({} distinct identifiers)\n",
+    typed.size(), vocabulary.size());
+  fmt::print("Popups shown:     {}\n", show_times.size());
+  fmt::print("Show time p50:    {:.3f} ms\n", percentile(show_times, 50));
+  fmt::print("Show time p99:    {:.3f} ms\n", percentile(show_times, 99));
+  fmt::print("Select time p50:  {:.3f} ms\n", percentile(select_times, 50));
+  fmt::print("Select time p99:  {:.3f} ms\n", percentile(select_times, 99));
+  fmt::print("Text cache hits:  {:.1f}% ({} / {})\n",
+    lookups ? 100. * hits / lookups : 0., hits, lookups);
+  return 0;
+}
+
+/// Filters a list of generated identifiers (like the ones an LSP server
+/// sends) by each prefix of a few typed words.
+static int fuzzy(std::size_t item_count)
+{
+  const std::vector<std::string> parts {
+    "get", "set", "buffer", "window", "draw", "text", "cache", "font",
+    "grid", "cursor", "popup", "menu", "item", "line", "size", "color",
+    "Render", "Event", "Handler", "Manager", "State", "Index", "Map", "List"
+  };
+  std::vector<std::string> items;
+  items.reserve(item_count);
+  std::uint32_t seed = 12345;
+  const auto next = [&] {
+    seed = seed * 1103515245u + 12345u;
+    return (seed >> 16) % parts.size();
+  };
+  while(items.size() < item_count)
+  {
+    std::string item = parts[next()] + parts[next()];
+    if (next() % 2) item += "_" + parts[next()];
+    item += std::to_string(items.size() % 100);
+    items.push_back(std::move(item));
+  }
+  QElapsedTimer timer;
+  timer.start();
+  FuzzyIndex index;
+  for(const auto& item : items) index.add(item);
+  const double build_ms = double(timer.nsecsElapsed()) / 1e6;
+  const std::vector<std::string> typed {
+    "getBufferLine", "draw_text", "popupMenuItem", "cursorState", "fontCache"
+  };
+  std::vector<double> filter_times;
+  std::size_t matched = 0;
+  for(const auto& word : typed)
+  {
+    for(std::size_t len = 1; len <= word.size(); ++len)
+    {
+      timer.restart();
+      const auto matches = index.filter(std::string_view(word).substr(0, len));
+      filter_times.push_back(double(timer.nsecsElapsed()) / 1e6);
+      matched += matches.size();
+    }
+  }
+  fmt::print("Items:            {}\n", index.size());
+  fmt::print("Index build:      {:.3f} ms\n", build_ms);
+  fmt::print("Keystrokes:       {}\n", filter_times.size());
+  fmt::print("Matches/key:      {:.1f}\n",
+    double(matched) / double(std::max<std::size_t>(filter_times.size(), 1)));
+  fmt::print("Filter time p50:  {:.3f} ms\n", percentile(filter_times, 50));
+  fmt::print("Filter time p99:  {:.3f} ms\n", percentile(filter_times, 99));
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+  {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QApplication app {argc, argv};
+  const std::vector<std::string> args(argv + 1, argv + argc);
+  if (auto corpus = get_arg(args, "--record="))
+  {
+    auto file = get_arg(args, "--file=").value_or("");
+    return record(*corpus, file, get_arg(args, "--guifont="));
+  }
+  if (auto corpus = get_arg(args, "--replay="))
+  {
+    const bool ligatures = std::find(
+      args.begin(), args.end(), "--ligatures"
+    ) != args.end();
+    return replay(*corpus, get_arg(args, "--dump-frames="), ligatures);
+  }
+  if (std::find(args.begin(), args.end(), "--popup") != args.end())
+  {
+    return popup(get_arg(args, "--file=").value_or("src/qpaintgrid.cpp"));
+  }
+  if (std::find(args.begin(), args.end(), "--fuzzy") != args.end())
+  {
+    const auto items = get_arg(args, "--items=").value_or("20000");
+    return fuzzy(std::stoul(items));
+  }
+  fmt::print(
+    "Usage:\n"
+    "  nvui_bench --record=<corpus> [--file=<file to edit>] [--guifont=<font>]\n"
+    "  nvui_bench --replay=<corpus> [--dump-frames=<dir>] [--ligatures]\n"
+    "  nvui_bench --popup [--file=<file>]\n"
+    "  nvui_bench --fuzzy [--items=<count>]\n"
+  );
+  return 1;
+}
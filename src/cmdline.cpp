@@ -1,4 +1,5 @@
 #include "cmdline.hpp"
+#include <algorithm>
 #include <QPainter>
 #include <QPaintEvent>
 #include <fmt/format.h>
@@ -22,10 +23,12 @@ void Cmdline::cmdline_show(std::span<const Object> objs)
   convert_content(content, line);
   cursor_pos = arr->at(1).try_convert<int>().value_or(0);
   auto* firstc = arr->at(2).string();
+  const auto prev_first_char = first_char;
   if (firstc && firstc->empty()) first_char.reset();
   else first_char = QString::fromStdString(*firstc);
   indent = arr->at(4).try_convert<int>().value_or(0);
-  update_content_string();
+  update_content_text();
+  if (first_char != prev_first_char) lines_reset();
   redraw();
   do_show();
 }
@@ -47,7 +50,7 @@ void Cmdline::cmdline_cursor_pos(std::span<const Object> objs)
     cursor_pos = arr->at(0).try_convert<int>().value_or(0);
     // const auto level = arr->at(1).get<u64>();
   }
-  redraw();
+  cursor_changed();
 }
 
 void Cmdline::set_fg(Color fg)
@@ -137,23 +140,28 @@ void Cmdline::convert_content(Content& cont, const ObjectArray& obj)
   }
 }
 
-void Cmdline::update_content_string()
+void Cmdline::update_content_text()
 {
-  auto& s = complete_content_string;
-  s.clear();
-  if (first_char) s.append(first_char.value());
-  for(const auto& line : block)
-  {
-    for(const auto& [_, text] : line) s.append(text);
-    s.append('\n');
-  }
-  s.append(QString(indent, QChar(' ')));
-  for(const auto& [_, text] : content) s.append(text);
+  content_text = QString(indent, QChar(' '));
+  for(const auto& [_, text] : content) content_text.append(text);
+}
+
+QString Cmdline::line_text(std::size_t i) const
+{
+  const QString& text = i < block.size() ? block[i].text : content_text;
+  if (i == 0 && first_char) return *first_char + text;
+  return text;
 }
 
 QString Cmdline::get_content_string() const
 {
-  return complete_content_string;
+  QString s;
+  for(std::size_t i = 0; i < line_count(); ++i)
+  {
+    if (i > 0) s.append('\n');
+    s.append(line_text(i));
+  }
+  return s;
 }
 
 void Cmdline::set_padding(u32 pad)
@@ -165,6 +173,7 @@ void Cmdline::cmdline_block_show(std::span<const Object> objs)
 {
   Q_UNUSED(objs);
   block.clear();
+  lines_reset();
   if (objs.empty()) return;
   if (!objs.back().is_array()) return;
   const auto& linesarr = objs.back().array_ref();
@@ -176,7 +185,7 @@ void Cmdline::cmdline_block_show(std::span<const Object> objs)
     {
       if (!line.is_array()) continue;
       const auto& to_convert = line.get<ObjectArray>();
-      convert_content(block.emplace_back(), to_convert);
+      append_block_line(to_convert);
     }
   }
   redraw();
@@ -188,10 +197,8 @@ void Cmdline::cmdline_block_append(std::span<const Object> objs)
   Q_UNUSED(objs);
   if (objs.empty()) return;
   const auto& line = objs.back().try_at(0);
-  if (line.is_array())
-  {
-    convert_content(block.emplace_back(), line.get<ObjectArray>());
-  }
+  // Only the new line gets laid out
+  if (line.is_array()) append_block_line(line.get<ObjectArray>());
   redraw();
 }
 
@@ -199,9 +206,17 @@ void Cmdline::cmdline_block_hide(std::span<const Object> objs)
 {
   Q_UNUSED(objs);
   block.clear();
+  lines_reset();
   redraw();
 }
 
+void Cmdline::append_block_line(const ObjectArray& chunks)
+{
+  auto& line = block.emplace_back();
+  convert_content(line.chunks, chunks);
+  for(const auto& [_, text] : line.chunks) line.text.append(text);
+}
+
 CmdlineQ::CmdlineQ(const HLState& hl_state, const Cursor* crs, QWidget* parent)
 : Cmdline(hl_state, crs), QWidget(parent)
 {
@@ -260,14 +275,6 @@ void CmdlineQ::border_changed()
 {
 }
 
-int CmdlineQ::num_lines(const Content& content, const QFontMetricsF& fm) const
-{
-  double maxwidth = width() - (border_width + padding) * 2;
-  double w = 0;
-  for(const auto& [_, text] : content) w += fm.horizontalAdvance(text);
-  return std::max(std::ceil(w / maxwidth), 1.);
-}
-
 void CmdlineQ::rect_changed(QRectF relative_rect)
 {
   auto* parent = parentWidget();
@@ -283,94 +290,106 @@ void CmdlineQ::rect_changed(QRectF relative_rect)
   }
 }
 
-static void incx(
-  float& left, float& top, float adv, float maxwidth, float pad, float height
-)
+void CmdlineQ::lines_reset()
 {
-  if (left + adv > maxwidth - pad)
-  {
-    left = pad;
-    top += height;
-  }
-  left += adv;
+  block_layouts.clear();
+  block_rows_total = 0;
+  current_layout.reset();
+}
+
+static int rows_of(const QTextLayout& layout)
+{
+  return std::max(layout.lineCount(), 1);
 }
 
-static std::tuple<float, float> draw_pos(
-  float left,
-  float top,
-  float adv,
-  float maxwidth,
-  float pad,
-  float height
-)
+std::unique_ptr<QTextLayout> CmdlineQ::layout_line(const QString& text) const
 {
-  if (left + adv > maxwidth - pad)
+  auto layout = std::make_unique<QTextLayout>(text, cmd_font);
+  QTextOption option;
+  option.setWrapMode(QTextOption::WrapAnywhere);
+  layout->setTextOption(option);
+  layout->setCacheEnabled(true);
+  const qreal line_width = std::max(width() - 2 * (border_width + padding), 1.f);
+  qreal y = 0;
+  layout->beginLayout();
+  for(QTextLine line = layout->createLine(); line.isValid();
+    line = layout->createLine())
   {
-    return {pad, top + height};
+    line.setLineWidth(line_width);
+    line.setPosition({0, y});
+    y += line_height;
   }
-  return {left, top};
+  layout->endLayout();
+  return layout;
 }
 
-int CmdlineQ::fitting_height() const
+void CmdlineQ::update_layout()
 {
-  int maxwidth = width() - (border_width + padding) * 2;
-  auto contentstring = get_content_string();
-  QFontMetricsF fm {cmd_font};
-  auto maxheight = fm.height() * contentstring.size();
-  QRectF constraint(0, 0, maxwidth, maxheight);
-  float pad = border_width + padding;
-  float left = pad;
-  float top = pad;
-  const auto adv_x = [&](float adv) {
-    incx(left, top, adv, width(), pad, fm.height());
-  };
-  for(const auto& c : contentstring)
+  if (layout_width != width() || layout_font != cmd_font)
   {
-    if (c == '\n') { left = pad; top += fm.height(); }
-    else adv_x(fm.horizontalAdvance(c));
+    lines_reset();
+    layout_width = width();
+    layout_font = cmd_font;
+    QFontMetricsF fm {cmd_font};
+    line_height = fm.height();
+    char_width = fm.averageCharWidth();
+  }
+  while(block_layouts.size() < block.size())
+  {
+    auto& layout = block_layouts.emplace_back(
+      layout_line(line_text(block_layouts.size()))
+    );
+    block_rows_total += rows_of(*layout);
+  }
+  const QString current = line_text(block.size());
+  if (!current_layout || current_layout->text() != current)
+  {
+    current_layout = layout_line(current);
   }
-  return top + fm.height() + pad;
 }
 
-void CmdlineQ::draw_cursor(QPainter& p, const Cursor& cursor)
+int CmdlineQ::fitting_height()
 {
-  if (cursor.hidden()) return;
-  if (!cursor.pos()) return;
-  int cur_content_length = 0;
-  for(const auto& chunk : content) cur_content_length += chunk.text.size();
-  QString contentstring = get_content_string();
-  int upto = contentstring.size() - cur_content_length + cursor_pos;
+  update_layout();
   float pad = border_width + padding;
-  QFontMetricsF fm {cmd_font};
-  float left = pad;
-  float top = pad;
-  const auto adv_x = [&](float adv) {
-    incx(left, top, adv, width(), pad, fm.height());
-  };
-  for(int i = 0; i < upto && i < contentstring.size(); ++i)
-  {
-    if (contentstring[i] == '\n') { left = pad; top += fm.height(); }
-    else
-    {
-      adv_x(fm.horizontalAdvance(contentstring[i]));
-    }
-  }
-  auto [rect, id, drawtext, opacity] = cursor.rect(
-    fm.averageCharWidth(), fm.height(), 1.0f, false
-  ).value();
-  rect.moveTo(left, top);
-  auto [fg, bg] = hl_state.colors_for(hl_state.attr_for_id(id));
-  if (id == 0) std::swap(fg, bg);
-  p.fillRect(rect, bg.qcolor());
+  const int rows = block_rows_total + rows_of(*current_layout);
+  return rows * line_height + 2 * pad;
+}
+
+QRect CmdlineQ::cursor_rect(const Cursor& cursor)
+{
+  if (cursor.hidden() || !cursor.pos()) return {};
+  update_layout();
+  // Position in the current line, which starts with the first
+  // character if there is no block
+  int upto = indent + cursor_pos;
+  if (block.empty() && first_char) upto += first_char->size();
+  upto = std::clamp(upto, 0, current_layout->text().size());
+  QTextLine line = current_layout->lineForTextPosition(upto);
+  if (!line.isValid()) line = current_layout->lineAt(current_layout->lineCount() - 1);
+  if (!line.isValid()) return {};
+  float pad = border_width + padding;
+  auto cursor_rect = cursor.rect(char_width, line_height, 1.0f, false);
+  if (!cursor_rect) return {};
+  auto rect = cursor_rect->rect;
+  rect.moveTo(
+    pad + line.cursorToX(upto),
+    pad + block_rows_total * line_height + line.y()
+  );
+  return rect.toAlignedRect();
+}
+
+void CmdlineQ::cursor_changed()
+{
+  if (isHidden() || !p_cursor) return;
+  const QRect damage = drawn_cursor.united(cursor_rect(*p_cursor));
+  if (!damage.isEmpty()) update(damage.adjusted(-1, -1, 1, 1));
 }
 
-void CmdlineQ::paintEvent(QPaintEvent*)
+void CmdlineQ::paintEvent(QPaintEvent* event)
 {
-  QFontMetricsF fm {cmd_font};
-  int offset = fm.ascent();
+  update_layout();
   QPainter p(this);
-  p.setFont(cmd_font);
-  auto contentstring = get_content_string();
   QColor bg = inner_bg.value_or(hl_state.default_bg()).qcolor();
   QColor fg = inner_fg.value_or(hl_state.default_fg()).qcolor();
   if (border_width > 0.f)
@@ -381,20 +400,25 @@ void CmdlineQ::paintEvent(QPaintEvent*)
   int border = border_width;
   QRect fill_rect(border, border, width() - 2 * border, height() - 2 * border);
   p.fillRect(fill_rect, bg);
-  int pad = border_width + padding;
-  float left = pad;
+  const float pad = border_width + padding;
+  const QRectF dirty = event->rect();
   float top = pad;
-  for(const auto& c : contentstring)
-  {
-    if (c == '\n') { left = pad; top += fm.height(); }
-    else
+  const auto draw_line = [&](const QTextLayout& layout) {
+    const float bottom = top + rows_of(layout) * line_height;
+    // Lines outside of the repainted area (e.g. on cursor blinks)
+    // aren't drawn
+    if (bottom > dirty.top() && top < dirty.bottom())
     {
-      auto adv = fm.horizontalAdvance(c);
-      auto [x, y] = draw_pos(left, top, adv, width(), pad, fm.height());
-      p.drawText(QPointF(x, y + offset), c);
-      incx(left, top, adv, width(), pad, fm.height());
+      layout.draw(&p, QPointF(pad, top));
     }
-  }
-  if (p_cursor) draw_cursor(p, *p_cursor);
+    top = bottom;
+  };
+  for(const auto& layout : block_layouts) draw_line(*layout);
+  draw_line(*current_layout);
+  drawn_cursor = p_cursor ? cursor_rect(*p_cursor) : QRect();
+  if (drawn_cursor.isEmpty()) return;
+  const auto id = p_cursor->rect(char_width, line_height, 1.0f, false)->hl_id;
+  auto [cursor_fg, cursor_bg] = hl_state.colors_for(hl_state.attr_for_id(id));
+  if (id == 0) std::swap(cursor_fg, cursor_bg);
+  p.fillRect(drawn_cursor, cursor_bg.qcolor());
 }
-
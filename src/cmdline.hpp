@@ -4,6 +4,8 @@
 #include <QObject>
 #include <QWidget>
 #include <QPixmap>
+#include <QTextLayout>
+#include <memory>
 #include <msgpack.hpp>
 #include <optional>
 #include "hlstate.hpp"
@@ -41,6 +43,8 @@ struct Cmdline
   void set_border_width(int pixels);
   void set_border_color(Color color);
   QString get_content_string() const;
+  /// Called when the cursor moved, or blinked.
+  virtual void cursor_changed() = 0;
 protected:
   struct Chunk
   {
@@ -48,6 +52,13 @@ protected:
     QString text;
   };
   using Content = std::vector<Chunk>;
+  /// A line of a cmdline block, with the text of its chunks joined
+  /// once when it's added.
+  struct Line
+  {
+    Content chunks;
+    QString text;
+  };
   const HLState& hl_state;
   const Cursor* p_cursor;
   std::optional<Color> inner_fg;
@@ -55,7 +66,11 @@ protected:
   std::optional<float> centered_x;
   std::optional<float> centered_y;
   Content content;
-  std::vector<Content> block;
+  /// Indent and text of the current line.
+  QString content_text;
+  /// Lines of the block are only ever appended until the block is
+  /// shown again or hidden, so layouts of earlier lines stay valid.
+  std::vector<Line> block;
   float border_width = 1.f;
   Color border_color {0};
   std::optional<QString> first_char;
@@ -70,9 +85,15 @@ protected:
   int cursor_pos = 0;
   bool is_hidden = true;
   int indent = 0;
-private:
-  QString complete_content_string;
 protected:
+  /// Number of lines, the current line included.
+  std::size_t line_count() const { return block.size() + 1; }
+  /// Text of line i (the last line is the current line).
+  /// The first character of the cmdline starts the first line.
+  QString line_text(std::size_t i) const;
+  /// Called when the block was replaced, or the first line changed,
+  /// so layouts of the block lines must be redone.
+  virtual void lines_reset() = 0;
   virtual void colors_changed(Color fg, Color bg) = 0;
   virtual void redraw() = 0;
   virtual void do_hide() = 0;
@@ -84,7 +105,8 @@ protected:
   virtual void border_changed() = 0;
   virtual void rect_changed(QRectF relative_rect) = 0;
 private:
-  void update_content_string();
+  void update_content_text();
+  void append_block_line(const ObjectArray& chunks);
   void convert_content(Content&, const ObjectArray&);
 };
 
@@ -107,10 +129,28 @@ protected:
   void paintEvent(QPaintEvent*) override;
 private:
   void editor_resized(int width, int height) override;
-  int num_lines(const Content&, const QFontMetricsF&) const;
-  int fitting_height() const;
-  void draw_cursor(QPainter&, const Cursor&);
+  void lines_reset() override;
+  void cursor_changed() override;
+  std::unique_ptr<QTextLayout> layout_line(const QString& text) const;
+  /// Lays out the block lines that weren't laid out yet (all of them
+  /// if the font or width changed), and the current line if it changed.
+  void update_layout();
+  int fitting_height();
+  /// Where the cursor is drawn, or an empty rect if it's hidden.
+  QRect cursor_rect(const Cursor&);
   QFont cmd_font;
+  /// Each line is shaped once into a QTextLayout, which wraps it to
+  /// the width of the cmdline.
+  std::vector<std::unique_ptr<QTextLayout>> block_layouts;
+  int block_rows_total = 0;
+  std::unique_ptr<QTextLayout> current_layout;
+  int layout_width = -1;
+  QFont layout_font;
+  float line_height = 0.f;
+  float char_width = 0.f;
+  /// Where the cursor was last drawn, so that blinking only repaints
+  /// the cursor.
+  QRect drawn_cursor;
 };
 
 #endif
@@ -4,6 +4,7 @@
 #include <fmt/core.h>
 #include <fmt/format.h>
 #include <QElapsedTimer>
+#include <algorithm>
 
 using scalers::time_scaler;
 time_scaler Cursor::animation_scaler = scalers::oneminusexpo2negative10;
@@ -19,18 +20,27 @@ Cursor::Cursor()
   blinkwait_timer.setSingleShot(true);
   blinkon_timer.setSingleShot(true);
   blinkoff_timer.setSingleShot(true);
+  // Once idle, the blinking stops with the cursor visible
   QObject::connect(&blinkwait_timer, &QTimer::timeout, [this]() {
+    wakeup();
+    if (blink_idle()) return;
     hide();
     set_blinkoff_timer(cur_mode.blinkwait);
   });
   QObject::connect(&blinkon_timer, &QTimer::timeout, [this]() {
+    wakeup();
+    if (blink_idle()) return;
     hide();
     set_blinkoff_timer(cur_mode.blinkoff);
   });
   QObject::connect(&blinkoff_timer, &QTimer::timeout, [this]() {
+    wakeup();
     show();
+    if (blink_idle()) return;
     set_blinkon_timer(cur_mode.blinkon);
   });
+  since_reset.start();
+  wakeup_clock.start();
   init_animations();
 }
 
@@ -83,6 +93,10 @@ void Cursor::register_nvim(Nvim& nvim)
       if (secs <= 0) set_effect("none");
       set_effect_anim_duration(secs);
   }));
+  on("NVUI_CURSOR_BLINK_IDLE",
+    paramify<double>([this](double secs) {
+      set_blink_idle_timeout(static_cast<int>(std::max(secs, 0.) * 1000));
+  }));
   on("NVUI_CURSOR_EFFECT_SCALER",
     paramify<std::string>([this](std::string scaler) {
       set_effect_ease_func(scaler);
@@ -125,6 +139,7 @@ void Cursor::init_animations()
     auto scaled = animation_scaler(finished);
     cur_x = old_x + (destination_x - old_x) * scaled;
     cur_y = old_y + (destination_y - old_y) * scaled;
+    wakeup();
     emit anim_state_changed();
   });
   move_animation.on_stop([this] {
@@ -145,6 +160,7 @@ void Cursor::init_animations()
         break;
       default: return;
     }
+    wakeup();
     emit anim_state_changed();
   });
   effect_animation.on_stop([this] {
@@ -154,8 +170,9 @@ void Cursor::init_animations()
       case CursorEffect::SmoothBlink:
       case CursorEffect::ExpandShrink:
         if (!animations_enabled()) return;
-        // continuous
-        effect_animation.start();
+        // continuous, until the cursor goes idle
+        if (blink_idle()) effect_idle = true;
+        else effect_animation.start();
         break;
       default: break;
     }
@@ -268,6 +285,12 @@ void Cursor::reset_timers() noexcept
 {
   if (busy()) return;
   show();
+  since_reset.start();
+  if (effect_idle)
+  {
+    effect_idle = false;
+    effect_animation.start();
+  }
   blinkwait_timer.stop();
   blinkoff_timer.stop();
   blinkon_timer.stop();
@@ -472,10 +495,39 @@ bool Cursor::use_animated_position() const
 
 double Cursor::opacity() const { return opacity_level; }
 
+void Cursor::set_blink_idle_timeout(int ms)
+{
+  blink_idle_ms = ms;
+  reset_timers();
+}
+
+bool Cursor::blink_idle() const
+{
+  return blink_idle_ms > 0 && since_reset.elapsed() >= blink_idle_ms;
+}
+
+void Cursor::wakeup()
+{
+  ++wakeups;
+  const qint64 now = wakeup_clock.elapsed();
+  recent_wakeups.push_back(now);
+  while(now - recent_wakeups.front() > 1000) recent_wakeups.pop_front();
+}
+
+std::size_t Cursor::wakeups_per_second() const
+{
+  const qint64 now = wakeup_clock.elapsed();
+  return static_cast<std::size_t>(std::count_if(
+    recent_wakeups.begin(), recent_wakeups.end(),
+    [now](qint64 t) { return now - t <= 1000; }
+  ));
+}
+
 void Cursor::set_effect(std::string_view eff)
 {
   bool valid_eff = true;
   effect_animation.stop();
+  effect_idle = false;
   if (eff == "smoothblink")
   {
     cursor_effect = CursorEffect::SmoothBlink;
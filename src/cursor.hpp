@@ -5,6 +5,7 @@
 #include <QRect>
 #include <QTimer>
 #include <cstdint>
+#include <deque>
 #include <span>
 #include <msgpack.hpp>
 #include "hlstate.hpp"
@@ -168,6 +169,18 @@ public:
   void set_effect_anim_frametime(int ms);
   void set_effect_ease_func(std::string_view funcname);
   double opacity() const;
+  /**
+   * Stop blinking (and the blink effects) once the cursor hasn't
+   * moved or changed mode for 'ms' milliseconds. The cursor stays
+   * visible until it's reset again. 0 means it never stops.
+   */
+  void set_blink_idle_timeout(int ms);
+  /**
+   * Number of times the cursor's timers and animations woke up
+   * the event loop, in total and over the last second.
+   */
+  std::uint64_t wakeup_count() const { return wakeups; }
+  std::size_t wakeups_per_second() const;
 private:
   float caret_extend_top = 0.f;
   float caret_extend_bottom = 0.f;
@@ -204,6 +217,15 @@ private:
   CursorEffect cursor_effect = CursorEffect::NoEffect;
   static scalers::time_scaler effect_ease_func;
   bool use_anims = true;
+  /// Blinking stops after this many ms without a reset (0 = never).
+  int blink_idle_ms = 10000;
+  QElapsedTimer since_reset;
+  /// Whether the continuous effect animation was stopped for idling.
+  bool effect_idle = false;
+  std::uint64_t wakeups = 0;
+  QElapsedTimer wakeup_clock;
+  /// Times of the wakeups in the last second (from wakeup_clock).
+  std::deque<qint64> recent_wakeups;
 signals:
   void anim_state_changed();
   void cursor_visible();
@@ -244,6 +266,14 @@ private:
     return status == CursorStatus::Busy;
   }
   bool use_animated_position() const;
+  /**
+   * Whether the blink idle timeout has passed since the last reset.
+   */
+  bool blink_idle() const;
+  /**
+   * Record a wakeup (a timer or animation tick).
+   */
+  void wakeup();
   void animate_smoothblink(double percent_finished);
   void animate_expandshrink(double percent_finished);
 };
@@ -93,12 +93,20 @@ void EditorBase::send_redraw()
   for(auto& grid : grids) grid->send_redraw();
 }
 
+void EditorBase::redraw_changed_hl()
+{
+  const auto changed = hl_state.take_changed_ids();
+  if (changed.empty()) return;
+  for(auto& grid : grids) grid->send_draw_for_hl_ids(changed);
+}
+
 void EditorBase::register_handlers()
 {
   // Set GUI handlers before we set the notification handler (since Nvim runs on a different thread,
   // it can be called any time)
   set_handler("hl_attr_define", [&](std::span<const Object> objs) {
-    for(const auto& obj : objs) hl_state.define(obj);
+    for(const auto& obj : objs) hl_state.define(obj, ext.hlstate);
+    redraw_changed_hl();
   });
   set_handler("hl_group_set", [&](std::span<const Object> objs) {
     for (const auto& obj : objs) hl_state.group_set(obj);
@@ -106,6 +114,7 @@ void EditorBase::register_handlers()
   set_handler("default_colors_set", [&](std::span<const Object> objs) {
     if (objs.empty()) return;
     hl_state.default_colors_set(objs.back());
+    redraw_changed_hl();
     default_colors_changed(default_fg(), default_bg());
   });
   set_handler("grid_line", [&](std::span<const Object> objs) {
@@ -199,7 +208,9 @@ void EditorBase::register_handlers()
     win_viewport(objs);
   });
   nvim->set_notification_handler("redraw", [this](Object msg) {
-    QMetaObject::invokeMethod(target_object, [this, o = std::move(msg)] {
+    const auto received = nvim->read_time();
+    QMetaObject::invokeMethod(target_object, [this, o = std::move(msg), received] {
+      input_latency.redraw_received(received);
       handle_redraw(std::move(o));
     });
   });
@@ -228,6 +239,7 @@ GridBase* EditorBase::find_grid(i64 grid_num)
 void EditorBase::flush()
 {
   if (grids_need_ordering) order_grids();
+  input_latency.flushed(InputLatency::clock::now());
   redraw();
 }
 
@@ -424,6 +436,7 @@ void EditorBase::option_set(std::span<const Object> objs)
     else if (s == "ext_multigrid") return &ext.multigrid;
     else if (s == "ext_wildmenu") return &ext.wildmenu;
     else if (s == "ext_messages") return &ext.messages;
+    else if (s == "ext_hlstate") return &ext.hlstate;
     else return nullptr;
   };
   for(const auto& obj : objs)
@@ -571,6 +584,27 @@ void EditorBase::popupmenu_show(std::span<const Object> objs)
   popup_menu->pum_show(
     items, selected, grid_num, row, col, font_dims, grid_x, grid_y
   );
+  if (grid && popup_menu->fuzzy_enabled())
+  {
+    popup_menu->set_completion_base(completion_base(*grid, row, col));
+  }
+}
+
+std::string EditorBase::completion_base(
+  const GridBase& grid,
+  int row,
+  int col
+) const
+{
+  const auto pos = n_cursor.pos();
+  if (!pos || pos->grid_num != grid.id || pos->row != row) return {};
+  if (row < 0 || row >= grid.rows || col < 0 || pos->col > grid.cols) return {};
+  std::string base;
+  for(int c = col; c < pos->col; ++c)
+  {
+    base += grid.area[std::size_t(row * grid.cols + c)].text.toStdString();
+  }
+  return base;
 }
 
 void EditorBase::popupmenu_hide(std::span<const Object> objs)
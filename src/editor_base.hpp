@@ -8,6 +8,7 @@
 #include "fontdesc.hpp"
 #include "grid.hpp"
 #include "hlstate.hpp"
+#include "input_latency.hpp"
 #include "object.hpp"
 #include "popupmenu.hpp"
 #include "nvim.hpp"
@@ -21,6 +22,7 @@ struct ExtensionCapabilities
   bool messages = false;
   bool cmdline = false;
   bool multigrid = false;
+  bool hlstate = false;
 };
 
 // Base class for Editor UIs.
@@ -147,6 +149,9 @@ private:
   void popupmenu_show(std::span<const Object> objs);
   void popupmenu_hide(std::span<const Object> objs);
   void popupmenu_select(std::span<const Object> objs);
+  /// The text between (row, col) of the grid and the cursor,
+  /// i.e. what is being completed when the popup menu is shown there.
+  std::string completion_base(const GridBase& grid, int row, int col) const;
   void set_mouse_enabled(bool enabled);
 private:
   virtual void do_close() = 0;
@@ -164,7 +169,8 @@ private:
   // class but things like linespace need to be handled by UI inheritors
   virtual void field_updated(std::string_view field, const Object& value);
   void register_handlers();
-  void handle_redraw(Object message);
+  /// Redraw the rows that use highlight ids whose colors changed.
+  void redraw_changed_hl();
   void order_grids();
   std::unordered_map<std::string, HandlerFunc> handlers;
   /**
@@ -175,6 +181,8 @@ private:
   void destroy_grid(u64 grid_num);
   i64 get_win(const NeovimExt& ext) const;
 protected:
+  /// Handles a Neovim "redraw" notification.
+  void handle_redraw(Object message);
   void set_handler(
     std::string name,
     HandlerFunc func
@@ -200,6 +208,7 @@ protected:
   FontDimensions ms_font_dimensions;
   std::string path_to_nvim;
   std::vector<std::string> args_to_nvim;
+  InputLatency input_latency;
 private:
   // Measures to prevent needless resizing requests
   QObject* target_object;
@@ -4,6 +4,7 @@
 #include <QFontMetrics>
 #include <QRawFont>
 #include "hlstate.hpp"
+#include "font_metrics_cache.hpp"
 
 // Font class created with the expectation that it will be modified
 // very rarely, but read very frequently
@@ -54,7 +55,7 @@ public:
 private:
   void update()
   {
-    QFontMetricsF metrics {font_};
+    const auto metrics = FontMetricsCache::instance().metrics(font_);
     bolditalic = font_;
     bold = font_;
     italic = font_;
@@ -62,7 +63,7 @@ private:
     bolditalic.setItalic(true);
     bold.setBold(true);
     italic.setItalic(true);
-    is_mono = metrics.horizontalAdvance('W') == metrics.horizontalAdvance('a');
+    is_mono = metrics.w_advance == metrics.a_advance;
   }
   QFont font_;
   QFont bolditalic;
@@ -0,0 +1,128 @@
+#include "font_fallback.hpp"
+#include "font.hpp"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+
+/// Identifies the file format, bump the version when it changes.
+static constexpr quint32 file_magic = 0x4E564642; // "NVFB"
+static constexpr quint32 file_version = 1;
+
+FontFallbackIndex::FontFallbackIndex()
+  : bmp(bmp_size, unknown)
+{
+}
+
+void FontFallbackIndex::set(u32 ucs, u32 font_idx)
+{
+  if (ucs < bmp_size && font_idx < unknown)
+  {
+    if (bmp[ucs] == unknown) ++count;
+    bmp[ucs] = static_cast<u16>(font_idx);
+  }
+  else
+  {
+    if (astral.insert_or_assign(ucs, font_idx).second) ++count;
+  }
+  modified = true;
+}
+
+void FontFallbackIndex::reset(QString new_key)
+{
+  std::fill(bmp.begin(), bmp.end(), unknown);
+  astral.clear();
+  count = 0;
+  modified = false;
+  fingerprint_key = std::move(new_key);
+}
+
+QString FontFallbackIndex::file_path(const QString& dir) const
+{
+  const auto hash = QCryptographicHash::hash(
+    fingerprint_key.toUtf8(), QCryptographicHash::Sha1
+  );
+  return QDir(dir).filePath(
+    QString("fallback-%1.bin").arg(QString::fromLatin1(hash.toHex()))
+  );
+}
+
+bool FontFallbackIndex::load(const QString& dir, std::size_t font_count)
+{
+  if (fingerprint_key.isEmpty()) return false;
+  QFile file {file_path(dir)};
+  if (!file.open(QIODevice::ReadOnly)) return false;
+  QDataStream in {&file};
+  quint32 magic = 0, version = 0, num_entries = 0;
+  QString saved_key;
+  in >> magic >> version >> saved_key >> num_entries;
+  // Hash collision or a file from another version
+  if (magic != file_magic || version != file_version
+      || saved_key != fingerprint_key)
+  {
+    return false;
+  }
+  auto key = fingerprint_key;
+  reset(std::move(key));
+  for(quint32 i = 0; i < num_entries && in.status() == QDataStream::Ok; ++i)
+  {
+    quint32 ucs = 0, font_idx = 0;
+    in >> ucs >> font_idx;
+    if (in.status() != QDataStream::Ok) break;
+    // Corrupt, don't trust any of it
+    if (font_idx >= font_count)
+    {
+      reset(fingerprint_key);
+      return false;
+    }
+    set(ucs, font_idx);
+  }
+  modified = false;
+  return in.status() == QDataStream::Ok;
+}
+
+bool FontFallbackIndex::save(const QString& dir)
+{
+  if (fingerprint_key.isEmpty() || !QDir().mkpath(dir)) return false;
+  QSaveFile file {file_path(dir)};
+  if (!file.open(QIODevice::WriteOnly)) return false;
+  QDataStream out {&file};
+  out << file_magic << file_version << fingerprint_key
+    << static_cast<quint32>(count);
+  for(u32 ucs = 0; ucs < bmp_size; ++ucs)
+  {
+    if (bmp[ucs] != unknown) out << quint32(ucs) << quint32(bmp[ucs]);
+  }
+  for(const auto& [ucs, font_idx] : astral)
+  {
+    out << quint32(ucs) << quint32(font_idx);
+  }
+  if (!file.commit()) return false;
+  modified = false;
+  return true;
+}
+
+QString FontFallbackIndex::fingerprint(std::span<const Font> fonts)
+{
+  QString key;
+  for(const auto& font : fonts)
+  {
+    const auto& raw = font.raw();
+    const auto head = raw.fontTable("head");
+    const auto head_hash = QCryptographicHash::hash(
+      head, QCryptographicHash::Md5
+    ).toHex();
+    key += raw.familyName() + QChar('/') + raw.styleName() + QChar('/')
+      + QString::fromLatin1(head_hash) + QChar(';');
+  }
+  return key;
+}
+
+QString FontFallbackIndex::default_dir()
+{
+  return QDir(
+    QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation)
+  ).filePath("font-fallback");
+}
@@ -0,0 +1,65 @@
+#ifndef NVUI_FONT_FALLBACK_HPP
+#define NVUI_FONT_FALLBACK_HPP
+
+#include <QString>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "types.hpp"
+
+class Font;
+
+/// Maps codepoints to the index of the first font in the fallback
+/// list that supports them.
+/// Lookups in the BMP go through a dense array, everything else
+/// through a hash map.
+/// The index can be saved to disk and loaded again, keyed by a
+/// fingerprint of the fallback list (see fingerprint()), so that
+/// characters don't have to be probed again after a restart.
+class FontFallbackIndex
+{
+public:
+  FontFallbackIndex();
+  std::optional<u32> find(u32 ucs) const
+  {
+    if (ucs < bmp_size && bmp[ucs] != unknown) return bmp[ucs];
+    if (astral.empty()) return std::nullopt;
+    auto it = astral.find(ucs);
+    if (it == astral.end()) return std::nullopt;
+    return it->second;
+  }
+  void set(u32 ucs, u32 font_idx);
+  /// Number of codepoints in the index.
+  std::size_t size() const { return count; }
+  /// Forget everything and start indexing for a new
+  /// fallback list (identified by key).
+  void reset(QString key = {});
+  const QString& key() const { return fingerprint_key; }
+  /// Whether there are entries that haven't been saved.
+  bool dirty() const { return modified; }
+  /// Load the index saved for the current key in dir, for a fallback
+  /// list of font_count fonts.
+  /// Returns false if there was nothing (valid) to load, in which case
+  /// the index is left empty.
+  bool load(const QString& dir, std::size_t font_count);
+  /// Save the index for the current key in dir.
+  bool save(const QString& dir);
+  /// A key identifying the fallback list: the families and styles of the
+  /// fonts in order, and a hash of each font's 'head' table, which
+  /// changes whenever the font file itself changes.
+  static QString fingerprint(std::span<const Font> fonts);
+  /// Directory where nvui stores its fallback indices.
+  static QString default_dir();
+private:
+  QString file_path(const QString& dir) const;
+  static constexpr u32 bmp_size = 0x10000;
+  static constexpr u16 unknown = 0xFFFF;
+  std::vector<u16> bmp;
+  std::unordered_map<u32, u32> astral;
+  std::size_t count = 0;
+  QString fingerprint_key;
+  bool modified = false;
+};
+
+#endif // NVUI_FONT_FALLBACK_HPP
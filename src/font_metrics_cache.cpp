@@ -0,0 +1,112 @@
+#include "font_metrics_cache.hpp"
+#include <QFontDatabase>
+#include <QFontMetricsF>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <cmath>
+
+FontMetricsCache& FontMetricsCache::instance()
+{
+  static FontMetricsCache cache;
+  return cache;
+}
+
+QString FontMetricsCache::key_for(const QFont& font)
+{
+  // QFont::key() doesn't include the letter spacing
+  return font.key() + QChar('|') + QString::number(font.letterSpacing());
+}
+
+QString FontMetricsCache::relative_key_for(
+  const QFont& target,
+  const QFont& relative
+)
+{
+  QFont normalized = relative;
+  normalized.setPointSizeF(target.pointSizeF());
+  return key_for(target) + QStringLiteral("->") + key_for(normalized);
+}
+
+CachedFontMetrics FontMetricsCache::metrics(const QFont& font)
+{
+  const auto key = key_for(font);
+  {
+    QMutexLocker lock {&mutex};
+    auto it = metrics_map.constFind(key);
+    if (it != metrics_map.constEnd()) return *it;
+  }
+  QFontMetricsF fm {font};
+  CachedFontMetrics m {
+    fm.horizontalAdvance('W'),
+    fm.horizontalAdvance('a'),
+    fm.height(),
+    fm.lineSpacing(),
+    fm.ascent()
+  };
+  QMutexLocker lock {&mutex};
+  metrics_map.insert(key, m);
+  return m;
+}
+
+double FontMetricsCache::relative_point_size(
+  const QFont& target,
+  const QFont& relative,
+  double tolerance,
+  std::size_t max_iterations
+)
+{
+  const auto key = relative_key_for(target, relative);
+  {
+    QMutexLocker lock {&mutex};
+    auto it = relative_sizes.constFind(key);
+    if (it != relative_sizes.constEnd()) return *it;
+  }
+  QFont modified = relative;
+  const double target_width = metrics(target).a_advance;
+  double low = 0.;
+  double high = target.pointSizeF() * 2.;
+  double result = high;
+  for(std::size_t rep = 0;
+      (rep < max_iterations || max_iterations == 0) && low <= high;
+      ++rep)
+  {
+    double mid = (low + high) / 2.;
+    result = mid;
+    modified.setPointSizeF(mid);
+    const double diff = target_width - metrics(modified).a_advance;
+    if (std::abs(diff) <= tolerance) break;
+    if (diff < 0) /** point size too big */ high = mid;
+    else if (diff > 0) /** point size too low */ low = mid;
+    else break;
+  }
+  QMutexLocker lock {&mutex};
+  relative_sizes.insert(key, result);
+  return result;
+}
+
+void FontMetricsCache::prewarm_zoom_levels(
+  const QFont& main,
+  std::vector<QFont> relative_fonts,
+  double tolerance,
+  std::size_t max_iterations
+)
+{
+  if (!QFontDatabase::supportsThreadedFontRendering()) return;
+  for(const double delta : {-1., 1.})
+  {
+    QFont zoomed = main;
+    const double size = main.pointSizeF() + delta;
+    if (size <= 0.) continue;
+    zoomed.setPointSizeF(size);
+    QThreadPool::globalInstance()->start(QRunnable::create(
+      [this, zoomed, relative_fonts, tolerance, max_iterations] {
+        metrics(zoomed);
+        for(const auto& f : relative_fonts)
+        {
+          relative_point_size(zoomed, f, tolerance, max_iterations);
+        }
+      }
+    ));
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef NVUI_FONT_METRICS_CACHE_HPP
+#define NVUI_FONT_METRICS_CACHE_HPP
+
+#include <QFont>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <optional>
+#include <vector>
+
+/// The font metrics nvui uses.
+struct CachedFontMetrics
+{
+  double w_advance;
+  double a_advance;
+  double height;
+  double line_spacing;
+  double ascent;
+};
+
+/// Memoizes font metrics by (family, style, point size, letter spacing)
+/// so that they only have to be measured once, no matter how many times
+/// the user zooms back and forth or how many editor instances there are.
+/// Also remembers the point sizes found for fallback fonts by
+/// set_relative_font_size in QEditor.
+/// Thread-safe, so the cache can be warmed on a thread pool.
+class FontMetricsCache
+{
+public:
+  /// The cache shared by every editor instance.
+  static FontMetricsCache& instance();
+  CachedFontMetrics metrics(const QFont& font);
+  /**
+   * Returns a point size for 'relative' such that the horizontal
+   * advance of the character 'a' is within tolerance of the target's
+   * horizontal advance for the same character.
+   * This is done using a binary search algorithm between
+   * (0, target.pointSizeF() * 2.). The algorithm runs in a loop, the number
+   * of times can be limited using max_iterations. If max_iterations is 0
+   * the loop will run without stopping until it is within error.
+   * The result is remembered, so the search only runs once for each
+   * (target, relative family/style) pair.
+   * The point size of 'relative' is ignored.
+   */
+  double relative_point_size(
+    const QFont& target,
+    const QFont& relative,
+    double tolerance,
+    std::size_t max_iterations
+  );
+  /// Measure the fonts for the zoom levels around 'main'
+  /// ('main' with its point size +- 1) on the thread pool.
+  /// relative_fonts are the fallback fonts that are sized relative
+  /// to 'main' (with the same tolerance and max_iterations).
+  void prewarm_zoom_levels(
+    const QFont& main,
+    std::vector<QFont> relative_fonts,
+    double tolerance,
+    std::size_t max_iterations
+  );
+private:
+  static QString key_for(const QFont& font);
+  static QString relative_key_for(const QFont& target, const QFont& relative);
+  QMutex mutex;
+  QHash<QString, CachedFontMetrics> metrics_map;
+  QHash<QString, double> relative_sizes;
+};
+
+#endif // NVUI_FONT_METRICS_CACHE_HPP
@@ -0,0 +1,135 @@
+#include "fuzzy.hpp"
+#include <algorithm>
+#include <cstring>
+
+static constexpr char fold(char c)
+{
+  return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+static constexpr bool is_upper(char c) { return c >= 'A' && c <= 'Z'; }
+static constexpr bool is_lower(char c) { return c >= 'a' && c <= 'z'; }
+
+/// Letters, digits and anything outside ASCII are part of a word.
+static constexpr bool is_word_char(char c)
+{
+  return is_lower(fold(c)) || (c >= '0' && c <= '9')
+    || static_cast<unsigned char>(c) >= 0x80;
+}
+
+static constexpr int mask_bit(char c)
+{
+  c = fold(c);
+  if (is_lower(c)) return c - 'a';
+  if (c >= '0' && c <= '9') return 26 + (c - '0');
+  if (c == '_') return 36;
+  // Everything else shares the remaining bits
+  return 37 + static_cast<unsigned char>(c) % 27;
+}
+
+/// Whether the character at pos starts a part of the word.
+static bool starts_part(std::string_view word, std::size_t pos)
+{
+  if (pos == 0) return true;
+  const char prev = word[pos - 1];
+  if (!is_word_char(prev)) return true;
+  return is_lower(prev) && is_upper(word[pos]);
+}
+
+std::uint64_t FuzzyIndex::char_mask(std::string_view s)
+{
+  std::uint64_t mask = 0;
+  for(const char c : s) mask |= std::uint64_t(1) << mask_bit(c);
+  return mask;
+}
+
+void FuzzyIndex::clear()
+{
+  text.clear();
+  folded.clear();
+  offsets.assign(1, 0);
+  masks.clear();
+}
+
+void FuzzyIndex::reserve(std::size_t words, std::size_t bytes)
+{
+  text.reserve(bytes);
+  folded.reserve(bytes);
+  offsets.reserve(words + 1);
+  masks.reserve(words);
+}
+
+void FuzzyIndex::add(std::string_view word)
+{
+  text.append(word);
+  for(const char c : word) folded.push_back(fold(c));
+  offsets.push_back(static_cast<std::uint32_t>(text.size()));
+  masks.push_back(char_mask(word));
+}
+
+std::optional<int> FuzzyIndex::score(
+  std::size_t i,
+  std::string_view query,
+  std::string_view raw_query
+) const
+{
+  constexpr int consecutive_bonus = 4;
+  constexpr int start_bonus = 8;
+  constexpr int part_bonus = 4;
+  constexpr int max_gap_penalty = 3;
+  const std::string_view raw = word(i);
+  const std::string_view w = std::string_view(folded).substr(
+    offsets[i], raw.size()
+  );
+  int total = 0;
+  std::size_t pos = 0;
+  std::size_t prev = 0;
+  for(std::size_t k = 0; k < query.size(); ++k)
+  {
+    const void* found = std::memchr(w.data() + pos, query[k], w.size() - pos);
+    if (!found) return std::nullopt;
+    const auto at = std::size_t(static_cast<const char*>(found) - w.data());
+    int s = 1;
+    if (k > 0 && at == prev + 1) s += consecutive_bonus;
+    else if (at == 0) s += start_bonus;
+    else if (starts_part(raw, at)) s += part_bonus;
+    const std::size_t gap = k > 0 ? at - prev - 1 : at;
+    s -= int(std::min<std::size_t>(gap, max_gap_penalty));
+    if (raw[at] == raw_query[k]) s += 1;
+    total += s;
+    prev = at;
+    pos = at + 1;
+  }
+  // Between equal matches, prefer the shorter word
+  return total * 16 - int(std::min<std::size_t>(w.size() - query.size(), 15));
+}
+
+std::vector<FuzzyIndex::Match> FuzzyIndex::filter(std::string_view query) const
+{
+  std::vector<Match> matches;
+  if (query.empty())
+  {
+    matches.reserve(size());
+    for(std::size_t i = 0; i < size(); ++i)
+    {
+      matches.push_back({static_cast<std::uint32_t>(i), 0});
+    }
+    return matches;
+  }
+  std::string lowered;
+  lowered.reserve(query.size());
+  for(const char c : query) lowered.push_back(fold(c));
+  const std::uint64_t query_mask = char_mask(lowered);
+  for(std::size_t i = 0; i < size(); ++i)
+  {
+    if ((masks[i] & query_mask) != query_mask) continue;
+    if (auto s = score(i, lowered, query))
+    {
+      matches.push_back({static_cast<std::uint32_t>(i), *s});
+    }
+  }
+  std::stable_sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) {
+    return a.score > b.score;
+  });
+  return matches;
+}
@@ -0,0 +1,55 @@
+#ifndef NVUI_FUZZY_HPP
+#define NVUI_FUZZY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Compact index of completion words for filtering them on the client
+/// side, without waiting for Neovim to send the filtered list.
+/// Words are stored back to back, both as given and ASCII-lowercased,
+/// with a bitmask of the characters each word contains. Words that are
+/// missing a character of the query are rejected by the mask alone,
+/// and the rest are matched with memchr (vectorized by the C library).
+class FuzzyIndex
+{
+public:
+  struct Match
+  {
+    /// Index of the word, in the order it was added.
+    std::uint32_t index;
+    int score;
+  };
+  void clear();
+  void reserve(std::size_t words, std::size_t bytes);
+  void add(std::string_view word);
+  std::size_t size() const { return masks.size(); }
+  std::string_view word(std::size_t i) const
+  {
+    return std::string_view(text).substr(offsets[i], offsets[i + 1] - offsets[i]);
+  }
+  /// Words that contain query as a subsequence (ignoring ASCII case),
+  /// best match first. Matches at the start of the word and of its
+  /// parts (after '_' or at a camelCase hump) and consecutive matches
+  /// rank higher. Words with the same score keep their order.
+  std::vector<Match> filter(std::string_view query) const;
+  /// The characters in s, as the bitmask used to reject words.
+  static std::uint64_t char_mask(std::string_view s);
+private:
+  /// Score of matching the lowercased query against word i
+  /// (raw_query is the query as typed), if it matches.
+  std::optional<int> score(
+    std::size_t i,
+    std::string_view query,
+    std::string_view raw_query
+  ) const;
+  std::string text;
+  std::string folded;
+  std::vector<std::uint32_t> offsets {0};
+  std::vector<std::uint64_t> masks;
+};
+
+#endif // NVUI_FUZZY_HPP
@@ -1,5 +1,6 @@
 #include "grid.hpp"
 #include "utils.hpp"
+#include <algorithm>
 
 scalers::time_scaler GridBase::scroll_scaler = scalers::oneminusexpo2negative10;
 scalers::time_scaler GridBase::move_scaler = scalers::oneminusexpo2negative10;
@@ -120,6 +121,7 @@ void GridBase::scroll(int top, int bot, int left, int right, int rows)
       }
     }
   }
+  mark_rows_dirty(top, bot);
   evt_q.push({PaintKind::Scroll, convert_grid_scroll_args(top, bot, left, right, rows)});
   modified = true;
 }
@@ -152,6 +154,7 @@ void GridBase::set_text(
     if (idx >= area.size()) return;
     area[idx] = {hl_id, c, is_dbl_width, ucs};
   }
+  mark_rows_dirty(row, row + 1);
   modified = true;
 }
 /**
@@ -164,6 +167,7 @@ void GridBase::set_size(u16 w, u16 h)
   resize_1d_vector(area, w, h, cols, rows, empty_cell);
   cols = w;
   rows = h;
+  mark_rows_dirty(0, rows);
 }
 /**
  * Set the position of the grid in terms of
@@ -237,5 +241,67 @@ void GridBase::clear()
   {
     gc = {0, " ", false, QChar(' ').unicode()};
   }
+  mark_rows_dirty(0, rows);
   send_clear();
 }
+
+void GridBase::mark_rows_dirty(int top, int bot)
+{
+  if (row_hl_dirty.size() != std::size_t(rows))
+  {
+    row_hl_ids.assign(rows, {});
+    row_hl_dirty.assign(rows, true);
+    return;
+  }
+  top = std::max(top, 0);
+  bot = std::min<int>(bot, rows);
+  for(int y = top; y < bot; ++y) row_hl_dirty[y] = true;
+}
+
+/// Whether the sorted ranges a and b have an element in common.
+static bool intersects(std::span<const int> a, std::span<const int> b)
+{
+  auto ai = a.begin();
+  auto bi = b.begin();
+  while(ai != a.end() && bi != b.end())
+  {
+    if (*ai < *bi) ++ai;
+    else if (*bi < *ai) ++bi;
+    else return true;
+  }
+  return false;
+}
+
+void GridBase::send_draw_for_hl_ids(std::span<const int> hl_ids)
+{
+  if (hl_ids.empty()) return;
+  std::vector<int> wanted(hl_ids.begin(), hl_ids.end());
+  std::sort(wanted.begin(), wanted.end());
+  wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+  if (row_hl_dirty.size() != std::size_t(rows)) mark_rows_dirty(0, rows);
+  // Consecutive affected rows are sent as one draw
+  int first_row = -1;
+  for(int y = 0; y <= rows; ++y)
+  {
+    bool affected = false;
+    if (y < rows)
+    {
+      auto& ids = row_hl_ids[y];
+      if (row_hl_dirty[y])
+      {
+        ids.clear();
+        for(int x = 0; x < cols; ++x) ids.push_back(area[y * cols + x].hl_id);
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        row_hl_dirty[y] = false;
+      }
+      affected = intersects(ids, wanted);
+    }
+    if (affected && first_row < 0) first_row = y;
+    else if (!affected && first_row >= 0)
+    {
+      send_draw({0, first_row, cols, y - first_row});
+      first_row = -1;
+    }
+  }
+}
@@ -8,7 +8,9 @@
 #include <QString>
 #include <cmath>
 #include <queue>
+#include <span>
 #include <variant>
+#include <vector>
 #include "scalers.hpp"
 
 using grid_char = QString;
@@ -149,6 +151,12 @@ public:
   bool operator<(const GridBase& other) const noexcept;
   void scroll(int top, int bot, int left, int right, int rows);
   void clear();
+  /**
+   * Queue draws for the rows that contain any of the given
+   * highlight ids, e.g. after the highlight attributes or the
+   * default colors changed.
+   */
+  void send_draw_for_hl_ids(std::span<const int> hl_ids);
 public:
   double x;
   double y;
@@ -193,6 +201,11 @@ protected:
     int rows;
     int cols;
   };
+  void mark_rows_dirty(int top, int bot);
+  /// The highlight ids used by each row, sorted and without duplicates.
+  /// Rebuilt lazily from the row's cells when it is marked dirty.
+  std::vector<std::vector<int>> row_hl_ids;
+  std::vector<bool> row_hl_dirty;
   static ScrollEventInfo convert_grid_scroll_args(
     int top, int bot, int left, int right, int rows, int cols = 0
   );
@@ -1,70 +1,108 @@
 #include "hlstate.hpp"
 #include "utils.hpp"
 #include <cassert>
+#include <utility>
 #include <iostream>
 #include <sstream>
+#include <string_view>
 
 namespace hl
 {
-  HLAttr hl_attr_from_object(const Object& obj)
+  /// Hash of a map key that is perfect over the keys we handle
+  /// (checked by the compiler, since duplicate case labels don't compile).
+  /// Other keys may collide with them, so a match still has to
+  /// be confirmed by comparing the strings.
+  static constexpr u32 key_hash(std::string_view key)
+  {
+    if (key.empty()) return 0;
+    return u32(key.size()) << 16
+      | u32(static_cast<unsigned char>(key.front())) << 8
+      | u32(static_cast<unsigned char>(key.back()));
+  }
+
+  static AttrState attr_state_from_object(const Object& obj)
+  {
+    AttrState state;
+    auto* map = obj.map();
+    if (!map) return state;
+    for(const auto& [key, val] : *map)
+    {
+      switch(key_hash(key))
+      {
+        case key_hash("hi_name"):
+          if (key == "hi_name" && val.is_string()) state.hi_name = val.get<std::string>();
+          break;
+        case key_hash("ui_name"):
+          if (key == "ui_name" && val.is_string()) state.ui_name = val.get<std::string>();
+          break;
+        case key_hash("kind"):
+          if (key == "kind" && val.is_string())
+          {
+            state.kind = val.get<std::string>() == "syntax" ? Kind::Syntax : Kind::UI;
+          }
+          break;
+        case key_hash("id"):
+          if (key == "id") state.id = val.try_convert<int>().value_or(0);
+          break;
+      }
+    }
+    return state;
+  }
+
+  HLAttr hl_attr_from_object(
+    const Object& obj,
+    std::vector<AttrState>* states
+  )
   {
-    using u32 = std::uint32_t;
     const auto* arr = obj.array();
     assert(arr && arr->size() >= 4);
     assert(arr->at(0).convertible<int>());
     const int id = (int) arr->at(0);
     auto* map_ptr = arr->at(1).map();
     if (!map_ptr) return {};
-    const ObjectMap& map = *map_ptr;
     HLAttr attr {id};
-    if (map.contains("foreground"))
+    // Walk the map once instead of looking up every key we know about
+    for(const auto& [key, val] : *map_ptr)
     {
-      assert(map.at("foreground").convertible<u32>());
-      attr.foreground = (u32) map.at("foreground");
-    }
-    if (map.contains("background"))
-    {
-      assert(map.at("background").convertible<u32>());
-      attr.background = (u32) map.at("background");
-    }
-    if (map.contains("reverse")) attr.reverse = true;
-    if (map.contains("special"))
-    {
-      assert(map.at("special").convertible<u32>());
-      attr.special = (u32) map.at("special");
-    }
-    if (map.contains("italic")) attr.font_opts |= FontOpts::Italic;
-    if (map.contains("bold")) attr.font_opts |= FontOpts::Bold;
-    if (map.contains("underline")) attr.font_opts |= FontOpts::Underline;
-    if (map.contains("strikethrough"))
-    {
-      attr.font_opts |= FontOpts::Strikethrough;
+      switch(key_hash(key))
+      {
+        case key_hash("foreground"):
+          if (key == "foreground") attr.foreground = val.try_convert<u32>();
+          break;
+        case key_hash("background"):
+          if (key == "background") attr.background = val.try_convert<u32>();
+          break;
+        case key_hash("special"):
+          if (key == "special") attr.special = val.try_convert<u32>();
+          break;
+        case key_hash("reverse"):
+          if (key == "reverse") attr.reverse = true;
+          break;
+        case key_hash("italic"):
+          if (key == "italic") attr.font_opts |= FontOpts::Italic;
+          break;
+        case key_hash("bold"):
+          if (key == "bold") attr.font_opts |= FontOpts::Bold;
+          break;
+        case key_hash("underline"):
+          if (key == "underline") attr.font_opts |= FontOpts::Underline;
+          break;
+        case key_hash("strikethrough"):
+          if (key == "strikethrough") attr.font_opts |= FontOpts::Strikethrough;
+          break;
+        case key_hash("undercurl"):
+          if (key == "undercurl") attr.font_opts |= FontOpts::Undercurl;
+          break;
+      }
     }
-    if (map.contains("undercurl")) attr.font_opts |= FontOpts::Undercurl;
+    // The info array is only filled in with ext_hlstate
+    if (!states) return attr;
     auto* info_arr = arr->at(3).array();
-    if (!arr) return attr;
+    if (!info_arr) return attr;
+    states->reserve(info_arr->size());
     for(const auto& o : *info_arr)
     {
-      AttrState state;
-      if (auto* hi_name = o.try_at("hi_name").string())
-      {
-        state.hi_name = *hi_name;
-      }
-      if (auto* ui_name = o.try_at("ui_name").string())
-      {
-        state.ui_name = *ui_name;
-      }
-      if (auto* kind = o.try_at("kind").string())
-      {
-        state.hi_name = *kind == "syntax"
-          ? Kind::Syntax
-          : Kind::UI;
-      }
-      if (auto hid = o.try_at("id").try_convert<int>())
-      {
-        state.id = hid.value();
-      }
-      attr.state.push_back(std::move(state));
+      states->push_back(attr_state_from_object(o));
     }
     return attr;
   }
@@ -99,6 +137,22 @@ void HLState::set_id_attr(int id, HLAttr attr)
     // attributes but just to make sure
     id_to_attr.resize((std::size_t) id + 1);
   }
+  if (id >= (int) resolved_attrs.size())
+  {
+    resolved_attrs.resize((std::size_t) id + 1, resolved_default);
+    uses_defaults.resize((std::size_t) id + 1, true);
+    defined.resize((std::size_t) id + 1, false);
+  }
+  const ResolvedAttr r = resolve(attr);
+  // No cell can use an id before it is defined, so only redefinitions
+  // need a redraw.
+  if (defined[id] && !(resolved_attrs[id] == r))
+  {
+    changed_ids.push_back(id);
+  }
+  resolved_attrs[id] = r;
+  defined[id] = true;
+  uses_defaults[id] = !attr.foreground || !attr.background || !attr.special;
   if (id == (int) id_to_attr.size())
   {
     id_to_attr.emplace_back(std::move(attr));
@@ -107,6 +161,19 @@ void HLState::set_id_attr(int id, HLAttr attr)
   id_to_attr[id] = std::move(attr);
 }
 
+ResolvedAttr HLState::resolve(const HLAttr& attr) const
+{
+  auto [fg, bg, sp] = attr.fg_bg_sp(default_colors);
+  return {fg.to_uint32(), bg.to_uint32(), sp.to_uint32(), attr.font_opts};
+}
+
+const std::vector<AttrState>* HLState::states_for(int id) const
+{
+  const auto it = attr_states.find(id);
+  if (it == attr_states.end()) return nullptr;
+  return &it->second;
+}
+
 void HLState::default_colors_set(const Object& obj)
 {
   // We only look at the first three values (the others are ctermfg
@@ -120,6 +187,20 @@ void HLState::default_colors_set(const Object& obj)
   default_colors.foreground = *fg;
   default_colors.background = *bg;
   default_colors.special = *sp;
+  resolved_default = resolve(default_colors);
+  for(std::size_t i = 0; i < id_to_attr.size(); ++i)
+  {
+    if (!uses_defaults[i]) continue;
+    const ResolvedAttr r = resolve(id_to_attr[i]);
+    if (resolved_attrs[i] == r) continue;
+    resolved_attrs[i] = r;
+    if (defined[i]) changed_ids.push_back(static_cast<int>(i));
+  }
+}
+
+std::vector<int> HLState::take_changed_ids()
+{
+  return std::exchange(changed_ids, {});
 }
 
 const HLAttr& HLState::default_colors_get() const
@@ -127,11 +208,12 @@ const HLAttr& HLState::default_colors_get() const
   return default_colors;
 }
 
-void HLState::define(const Object& obj)
+void HLState::define(const Object& obj, bool ext_hlstate)
 {
-  HLAttr attr = hl::hl_attr_from_object(obj);
+  std::vector<AttrState> states;
+  HLAttr attr = hl::hl_attr_from_object(obj, ext_hlstate ? &states : nullptr);
   int id = attr.hl_id;
-  for(const AttrState& s : attr.state)
+  for(const AttrState& s : states)
   {
     if (!s.hi_name.empty())
     {
@@ -142,6 +224,8 @@ void HLState::define(const Object& obj)
       set_name_id(s.ui_name, id);
     }
   }
+  if (states.empty()) attr_states.erase(id);
+  else attr_states[id] = std::move(states);
   set_id_attr(attr.hl_id, std::move(attr));
 }
 
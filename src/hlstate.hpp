@@ -132,12 +132,23 @@ public:
   std::optional<Color> special {};
   std::optional<Color> foreground {};
   std::optional<Color> background {};
-  /// We don't need a detailed view of the highlight state
-  // right now so we won't do anything with this.
-  std::vector<AttrState> state {};
   float opacity = 1;
 };
 
+/// The colours of a highlight attribute with the default colours
+/// and "reverse" already applied, packed together with its font options.
+/// This is all the renderer needs to draw a run of text, so
+/// HLState keeps a dense table of these (indexed by hl id) that
+/// is only recomputed when the attributes or default colours change.
+struct ResolvedAttr
+{
+  uint32 fg = 0x00ffffff;
+  uint32 bg = 0;
+  uint32 sp = 0x00ffffff;
+  FontOptions font_opts = FontOpts::Normal;
+  bool operator==(const ResolvedAttr&) const = default;
+};
+
 /// Keeps the highlight state of Neovim
 /// HlState is essentially a map of highlight names to their
 /// corresponding id's, and a secondary map of id's to
@@ -147,6 +158,8 @@ class HLState
 public:
   HLState() {
     id_to_attr.reserve(1000);
+    resolved_attrs.reserve(1000);
+    uses_defaults.reserve(1000);
   }
   /**
    * Maps name to hl_id.
@@ -168,8 +181,9 @@ public:
   /**
    * Manages an "hl_attr_define" call, with obj
    * being the parameters of the call.
+   * The highlight state info is only parsed with ext_hlstate.
    */
-  void define(const Object& obj);
+  void define(const Object& obj, bool ext_hlstate = false);
   /**
    * Sets the default colors.
    */
@@ -186,11 +200,46 @@ public:
   Color default_bg() const { return default_colors.bg().value_or(NVUI_BLACK); }
   Color default_fg() const { return default_colors.fg().value_or(NVUI_WHITE); }
   HLAttr::ColorPair colors_for(const HLAttr& attr) const;
+  /**
+   * Returns the resolved colours and font options for the given id.
+   * Ids that haven't been defined resolve to the default colours.
+   */
+  const ResolvedAttr& resolved(int id) const
+  {
+    if (id < 0 || id >= (int) resolved_attrs.size()) return resolved_default;
+    return resolved_attrs[id];
+  }
+  /**
+   * Returns the ext_hlstate info for the given id, or nullptr
+   * if Neovim didn't send any.
+   */
+  const std::vector<AttrState>* states_for(int id) const;
+  /**
+   * Returns the ids whose resolved attributes changed since the
+   * last call, through "hl_attr_define" or "default_colors_set".
+   * Ids defined for the first time aren't included.
+   */
+  std::vector<int> take_changed_ids();
 private:
+  ResolvedAttr resolve(const HLAttr& attr) const;
   HLAttr default_colors;
+  ResolvedAttr resolved_default;
   std::unordered_map<std::string, std::uint32_t> name_to_id;
   //std::unordered_map<int, HLAttr> id_to_attr;
   std::vector<HLAttr> id_to_attr {1};
+  /// Parallel to id_to_attr.
+  std::vector<ResolvedAttr> resolved_attrs {1};
+  /// Whether the attribute falls back to any of the default colours.
+  /// Only these need to be resolved again when the defaults change.
+  /// Parallel to id_to_attr.
+  std::vector<bool> uses_defaults {true};
+  /// Whether Neovim sent the attribute (id 0 is always defined).
+  /// Parallel to id_to_attr.
+  std::vector<bool> defined {true};
+  std::vector<int> changed_ids;
+  /// The ext_hlstate info is only needed to map names to ids,
+  /// so it's kept out of the attributes.
+  std::unordered_map<int, std::vector<AttrState>> attr_states;
 };
 
 /// Defining a function to parse "hl_attr_define" data
@@ -204,8 +253,13 @@ namespace hl
    * and should only be called with arrays
    * that were the parameters of an "hl_attr_define"
    * call.
+   * If states is not null, the ext_hlstate info of the
+   * attribute is parsed into it.
    */
-  HLAttr hl_attr_from_object(const Object& obj);
+  HLAttr hl_attr_from_object(
+    const Object& obj,
+    std::vector<AttrState>* states = nullptr
+  );
 }
 
 namespace font
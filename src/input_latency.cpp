@@ -0,0 +1,86 @@
+#include "input_latency.hpp"
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+static double ms_between(
+  InputLatency::clock::time_point from,
+  InputLatency::clock::time_point to
+)
+{
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+InputLatency::InputLatency(std::size_t capacity)
+  : max_rows(std::max<std::size_t>(capacity, 1))
+{
+  for(auto& samples : stage_samples) samples = RollingSamples(max_rows);
+}
+
+void InputLatency::key_pressed(clock::time_point t)
+{
+  if (in_flight && !in_flight->redraw && t - in_flight->key > stale_after)
+  {
+    ++dropped;
+    in_flight.reset();
+  }
+  if (in_flight) ++folded;
+  else in_flight = InFlight {t, {}, {}, {}};
+}
+
+void InputLatency::input_written(clock::time_point t)
+{
+  if (in_flight && !in_flight->written) in_flight->written = t;
+}
+
+void InputLatency::redraw_received(clock::time_point t)
+{
+  if (!in_flight || !in_flight->written || in_flight->redraw) return;
+  // Read before the input got to Neovim, so it isn't an answer to it
+  if (t < *in_flight->written) return;
+  in_flight->redraw = t;
+}
+
+void InputLatency::flushed(clock::time_point t)
+{
+  if (in_flight && in_flight->redraw && !in_flight->flush)
+  {
+    in_flight->flush = t;
+  }
+}
+
+bool InputLatency::painted(clock::time_point t)
+{
+  if (!in_flight || !in_flight->flush) return false;
+  const auto& f = *in_flight;
+  const std::array<double, StageCount> row {
+    ms_between(f.key, *f.written),
+    ms_between(*f.written, *f.redraw),
+    ms_between(*f.redraw, *f.flush),
+    ms_between(*f.flush, t),
+    ms_between(f.key, t)
+  };
+  for(std::size_t i = 0; i < StageCount; ++i) stage_samples[i].add(row[i]);
+  if (rows.size() == max_rows) rows.pop_front();
+  rows.push_back(row);
+  in_flight.reset();
+  return true;
+}
+
+std::string InputLatency::csv() const
+{
+  std::string out = fmt::format("{}\n", fmt::join(stage_names, ","));
+  for(const auto& row : rows)
+  {
+    out += fmt::format("{:.3f}\n", fmt::join(row, ","));
+  }
+  return out;
+}
+
+void InputLatency::clear()
+{
+  in_flight.reset();
+  for(auto& samples : stage_samples) samples.clear();
+  rows.clear();
+  folded = 0;
+  dropped = 0;
+}
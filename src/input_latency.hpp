@@ -0,0 +1,82 @@
+#ifndef NVUI_INPUT_LATENCY_HPP
+#define NVUI_INPUT_LATENCY_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "stats.hpp"
+
+/// Follows key presses through nvui and Neovim until their result is
+/// painted, and times each stage on the way:
+///   write:   key press -> input written to Neovim's stdin
+///   nvim:    input written -> first redraw batch read back
+///   process: redraw read -> its flush handled
+///   paint:   flush handled -> frame painted
+///   total:   key press -> frame painted
+/// Key presses made before the previous one was painted are folded into
+/// its sample (the sample times the first of them). All the timestamps
+/// must be given on the same thread.
+class InputLatency
+{
+public:
+  using clock = std::chrono::steady_clock;
+  enum Stage : std::size_t
+  {
+    Write,
+    Nvim,
+    Process,
+    Paint,
+    Total,
+    StageCount
+  };
+  static constexpr std::array<std::string_view, StageCount> stage_names {
+    "write", "nvim", "process", "paint", "total"
+  };
+  /// Upper bounds (in ms) of the histogram buckets.
+  static constexpr std::array<double, 8> bucket_bounds {
+    1., 2., 4., 8., 16., 33., 66., 133.
+  };
+  /// A key press that hasn't seen a redraw after this long is assumed
+  /// to have changed nothing on the screen, and is dropped.
+  static constexpr clock::duration stale_after = std::chrono::seconds(1);
+  InputLatency(std::size_t capacity = 256);
+  void key_pressed(clock::time_point t);
+  void input_written(clock::time_point t);
+  /// t is when the redraw batch was read from Neovim.
+  void redraw_received(clock::time_point t);
+  void flushed(clock::time_point t);
+  /// Returns true if this completed a sample.
+  bool painted(clock::time_point t);
+  const RollingSamples& samples(Stage stage) const
+  {
+    return stage_samples[stage];
+  }
+  /// Key presses folded into an earlier key press' sample.
+  std::size_t folded_keys() const { return folded; }
+  /// Key presses dropped because Neovim didn't redraw after them.
+  std::size_t dropped_keys() const { return dropped; }
+  /// The most recent samples as CSV (in ms), one key press per line,
+  /// oldest first.
+  std::string csv() const;
+  void clear();
+private:
+  struct InFlight
+  {
+    clock::time_point key;
+    std::optional<clock::time_point> written;
+    std::optional<clock::time_point> redraw;
+    std::optional<clock::time_point> flush;
+  };
+  std::size_t max_rows;
+  std::optional<InFlight> in_flight;
+  std::array<RollingSamples, StageCount> stage_samples;
+  std::deque<std::array<double, StageCount>> rows;
+  std::size_t folded = 0;
+  std::size_t dropped = 0;
+};
+
+#endif // NVUI_INPUT_LATENCY_HPP
@@ -1,8 +1,12 @@
 #ifndef NVUI_LRU_HPP
 #define NVUI_LRU_HPP
 
+#include <algorithm>
 #include <cstdint>
-#include <list>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
 #include <QHash>
 #include <QPair>
 
@@ -13,6 +17,18 @@ struct do_nothing_deleter
   void operator()(T* p) const { Q_UNUSED(p); }
 };
 
+/// Default size of a cache entry, which only counts the entry itself
+/// (not any memory it owns).
+/// Specify your own to get meaningful memory accounting.
+template<typename K, typename V>
+struct entry_size
+{
+  std::size_t operator()(const K&, const V&) const
+  {
+    return sizeof(K) + sizeof(V);
+  }
+};
+
 /// LRUCache with optional custom deleter
 /// I use the custom deleter for IDWriteTextLayout1
 /// so they get automatically released
@@ -21,87 +37,229 @@ struct do_nothing_deleter
 /// Once again, using Neovide's idea of caching text blobs.
 /// See
 /// https://github.com/neovide/neovide/blob/main/src/renderer/fonts/caching_shaper.rs
-/// Uses QHash internally since it's expected to be used with QString
+/// Uses qHash for hashing since it's expected to be used with QString
 /// to cache drawn text.
-template<typename K, typename V, typename ValueDeleter = do_nothing_deleter<V>>
+///
+/// The entries live in a slab that grows as entries are added (up to the
+/// capacity, so a cache that stays small stays small), and are linked
+/// together intrusively by index, both for the LRU order and for the
+/// hash chains. The slab grows in chunks, so entries never move.
+/// The key is only stored once, and inserting doesn't allocate apart
+/// from what copying the key/value allocates.
+/// Entries are evicted when there are more than 'capacity' of them or,
+/// if a byte budget is given, when the total size of the entries
+/// (as computed by EntrySize) goes over the budget.
+/// K and V must be default constructible.
+template<
+  typename K,
+  typename V,
+  typename ValueDeleter = do_nothing_deleter<V>,
+  typename EntrySize = entry_size<K, V>
+>
 class LRUCache
 {
+  using index_type = std::uint32_t;
+  static constexpr index_type npos = std::numeric_limits<index_type>::max();
+  struct Node
+  {
+    K key {};
+    V value {};
+    std::size_t hash = 0;
+    std::size_t bytes = 0;
+    /// LRU list links (prev is towards the most recently used).
+    index_type prev = npos;
+    index_type next = npos;
+    /// Next node in the same hash bucket, or in the free list.
+    index_type chain = npos;
+    bool used = false;
+  };
 public:
   using key_type = K;
   using value_type = V;
-  LRUCache(std::size_t capacity)
-    : max_size(capacity),
-      map(),
-      keys()
+  /// Lookup statistics, used for profiling.
+  struct Stats
+  {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+  };
+  /// byte_budget = 0 means there is no byte budget.
+  LRUCache(std::size_t capacity, std::size_t byte_budget = 0)
+    : max_size(std::max<std::size_t>(capacity, 1)),
+      max_bytes(byte_budget)
   {
-    map.reserve(static_cast<int>(max_size));
+    std::size_t bucket_count = 1;
+    while(bucket_count < max_size) bucket_count <<= 1;
+    buckets.assign(bucket_count, npos);
   }
 
   V& put(K k, V v)
   {
-    V* ptr = nullptr;
-    auto it = map.find(k);
-    if (it != map.end())
+    const std::size_t h = qHash(k);
+    const std::size_t bytes = EntrySize()(k, v);
+    index_type idx = find(k, h);
+    if (idx != npos)
     {
-      it->first = std::move(v);
-      ptr = &it->first;
-      move_to_front(it->second);
+      Node& node = nodes[idx];
+      ValueDeleter()(std::addressof(node.value));
+      node.value = std::move(v);
+      total_bytes = total_bytes - node.bytes + bytes;
+      node.bytes = bytes;
+      move_to_front(idx);
     }
     else
     {
-      keys.push_front(k);
-      auto& pair_ref = map[k];
-      pair_ref = {v, keys.begin()};
-      ptr = &pair_ref.first;
-    }
-    if (keys.size() > max_size)
-    {
-      const auto& back_key = keys.back();
-      auto erase_it = map.find(back_key);
-      ValueDeleter()(std::addressof(erase_it->first));
-      map.erase(erase_it);
-      keys.pop_back();
+      if (num_entries == max_size) evict(tail);
+      idx = allocate();
+      Node& node = nodes[idx];
+      node.key = std::move(k);
+      node.value = std::move(v);
+      node.hash = h;
+      node.bytes = bytes;
+      node.used = true;
+      auto& bucket = buckets[h & (buckets.size() - 1)];
+      node.chain = bucket;
+      bucket = idx;
+      link_front(idx);
+      ++num_entries;
+      total_bytes += bytes;
     }
-    return *ptr;
+    // Never evict the entry that was just inserted
+    while(max_bytes && total_bytes > max_bytes && tail != idx) evict(tail);
+    return nodes[idx].value;
   }
 
   V* get(const K& k)
   {
-    auto it = map.find(k);
-    if (it != map.end())
+    index_type idx = find(k, qHash(k));
+    if (idx != npos)
     {
-      move_to_front(it->second);
-      return std::addressof(it->first);
+      ++cache_stats.hits;
+      move_to_front(idx);
+      return std::addressof(nodes[idx].value);
     }
     else
     {
+      ++cache_stats.misses;
       return nullptr;
     }
   }
 
+  const Stats& stats() const { return cache_stats; }
+  /// Number of entries in the cache.
+  std::size_t size() const { return num_entries; }
+  /// Total size of the entries, as computed by EntrySize.
+  std::size_t bytes() const { return total_bytes; }
+  std::size_t capacity() const { return max_size; }
+  std::size_t byte_budget() const { return max_bytes; }
+
   ~LRUCache()
   {
     constexpr auto deleter = ValueDeleter();
-    for(auto& val : map) deleter(std::addressof(val.first));
+    for(auto& node : nodes)
+    {
+      if (node.used) deleter(std::addressof(node.value));
+    }
   }
 
   void clear()
   {
     constexpr auto deleter = ValueDeleter();
-    for(auto& val : map) deleter(std::addressof(val.first));
-    map.clear();
-    keys.clear();
+    for(auto& node : nodes)
+    {
+      if (node.used) deleter(std::addressof(node.value));
+    }
+    nodes.clear();
+    std::fill(buckets.begin(), buckets.end(), npos);
+    head = tail = free_list = npos;
+    num_entries = 0;
+    total_bytes = 0;
   }
 
 private:
-  // https://stackoverflow.com/questions/14579957/std-container-c-move-to-front
-  void move_to_front(typename std::list<K>::iterator it)
+  index_type find(const K& k, std::size_t h) const
+  {
+    index_type idx = buckets[h & (buckets.size() - 1)];
+    while(idx != npos)
+    {
+      const Node& node = nodes[idx];
+      if (node.hash == h && node.key == k) return idx;
+      idx = node.chain;
+    }
+    return npos;
+  }
+
+  /// Get a free slot. The slab never grows past max_size.
+  index_type allocate()
   {
-    if (it != keys.begin()) keys.splice(keys.begin(), keys, it);
+    if (free_list != npos)
+    {
+      index_type idx = free_list;
+      free_list = nodes[idx].chain;
+      return idx;
+    }
+    nodes.emplace_back();
+    return static_cast<index_type>(nodes.size() - 1);
   }
+
+  void evict(index_type idx)
+  {
+    if (idx == npos) return;
+    Node& node = nodes[idx];
+    // Unlink from the hash chain
+    auto* link = &buckets[node.hash & (buckets.size() - 1)];
+    while(*link != idx) link = &nodes[*link].chain;
+    *link = node.chain;
+    unlink(idx);
+    ValueDeleter()(std::addressof(node.value));
+    // Release whatever the key and value hold on to
+    node.key = K {};
+    node.value = V {};
+    node.used = false;
+    node.chain = free_list;
+    free_list = idx;
+    total_bytes -= node.bytes;
+    --num_entries;
+    ++cache_stats.evictions;
+  }
+
+  void unlink(index_type idx)
+  {
+    Node& node = nodes[idx];
+    if (node.prev != npos) nodes[node.prev].next = node.next;
+    else head = node.next;
+    if (node.next != npos) nodes[node.next].prev = node.prev;
+    else tail = node.prev;
+    node.prev = node.next = npos;
+  }
+
+  void link_front(index_type idx)
+  {
+    Node& node = nodes[idx];
+    node.prev = npos;
+    node.next = head;
+    if (head != npos) nodes[head].prev = idx;
+    head = idx;
+    if (tail == npos) tail = idx;
+  }
+
+  void move_to_front(index_type idx)
+  {
+    if (idx == head) return;
+    unlink(idx);
+    link_front(idx);
+  }
+
   std::size_t max_size = 10;
-  QHash<K, QPair<V, typename std::list<K>::iterator>> map;
-  std::list<K> keys;
+  std::size_t max_bytes = 0;
+  std::deque<Node> nodes;
+  std::vector<index_type> buckets;
+  index_type head = npos;
+  index_type tail = npos;
+  index_type free_list = npos;
+  std::size_t num_entries = 0;
+  std::size_t total_bytes = 0;
+  Stats cache_stats;
 };
 
 #endif // NVUI_LRU_HPP
@@ -46,6 +46,11 @@ Nvim::Nvim(std::string path, std::vector<std::string> args)
   stdin_pipe(),
   error()
 {
+  if (path == detached_path)
+  {
+    detached = true;
+    return;
+  }
   auto nvim_path = get_nvim_path(path);
   if (nvim_path.empty())
   {
@@ -74,6 +79,7 @@ Object Nvim::get_api_info()
 template<typename T>
 Object Nvim::send_blocking_request(const std::string& method, T&& params)
 {
+  if (detached) return Object::null;
   std::mutex m;
   std::unique_lock<std::mutex> lock {m};
   std::condition_variable cv;
@@ -103,6 +109,7 @@ void Nvim::read_output_sync()
     using std::size_t;
     auto msg_size = static_cast<size_t>(stdout_pipe.read(buf, buffer_maxsize));
     if (!msg_size) continue;
+    last_read = std::chrono::steady_clock::now();
     std::string_view sv {buf, msg_size};
     std::size_t offset = 0;
     while(offset < msg_size)
@@ -214,7 +221,7 @@ std::vector<std::string> Nvim::default_args()
 
 int Nvim::exit_code()
 {
-  if (nvim.running())
+  if (detached || nvim.running())
   {
     return INT_MIN;
   }
@@ -224,7 +231,7 @@ int Nvim::exit_code()
 
 bool Nvim::running()
 {
-  return nvim.running();
+  return !detached && nvim.running();
 }
 
 void Nvim::set_notification_handler(
@@ -319,13 +326,35 @@ void Nvim::input_mouse(
   std::string modifiers,
   int grid,
   int row,
-  int col
+  int col,
+  int count
 )
 {
-  send_notification("nvim_input_mouse", std::tuple {
-      std::move(button), std::move(action), std::move(modifiers),
-      grid, row, col
-  });
+  if (count == 1)
+  {
+    send_notification("nvim_input_mouse", std::tuple {
+        std::move(button), std::move(action), std::move(modifiers),
+        grid, row, col
+    });
+    return;
+  }
+  if (detached) return;
+  std::unique_lock<std::mutex> lock {input_mutex};
+  const std::uint64_t msg_type = Type::Notification;
+  const auto params = std::tuple {button, action, modifiers, grid, row, col};
+  msgpack::sbuffer sbuf;
+  for(int i = 0; i < count; ++i)
+  {
+    msgpack::pack(sbuf, std::tuple {msg_type, "nvim_input_mouse", params});
+  }
+  try
+  {
+    stdin_pipe.write(sbuf.data(), static_cast<int>(sbuf.size()));
+  }
+  catch (const std::exception& e)
+  {
+    fmt::print("Exception occurred: {}\n", e.what());
+  }
 }
 
 void Nvim::set_client_info(const ClientInfo& info)
@@ -337,6 +366,7 @@ Nvim::~Nvim()
 {
   // Close I/O Pipes and terminate process
   closed = true;
+  if (detached) return;
   nvim.terminate();
   error.pipe().close();
   stdout_pipe.close();
@@ -4,9 +4,11 @@
 #include <boost/process/pipe.hpp>
 #include <boost/process.hpp>
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <iostream>
 #include <optional>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <vector>
@@ -56,6 +58,10 @@ public:
    * The Neovim instance is created with the command "nvim --embed".
    */
   Nvim(std::string path = "", std::vector<std::string> args = {"--embed"});
+  /// Passing this as the path creates an Nvim without a process behind it:
+  /// nothing is started, everything sent to it is dropped and blocking
+  /// requests return nil. Used to replay recorded redraw events.
+  static constexpr std::string_view detached_path = "<detached>";
   /**
    * Get the exit code of the Neovim instance.
    * If Neovim is still running, the exit code that is return will be INT_MIN.
@@ -176,6 +182,8 @@ public:
   /**
    * Send a mouse input event with the given parameters.
    * Corresponds directly to Neovim API's nvim_input_mouse function.
+   * The event is sent 'count' times, in a single write
+   * (e.g. to scroll by several steps at once).
    */
   void input_mouse(
     std::string button,
@@ -183,7 +191,8 @@ public:
     std::string modifiers,
     int grid,
     int row,
-    int col
+    int col,
+    int count = 1
   );
   /**
    * Send the response to Neovim for the given msgid,
@@ -217,6 +226,12 @@ public:
     send_notification("nvim_err_write", std::tuple {str});
   }
   bool exited() const { return did_exit; }
+  /**
+   * When the output currently being handled was read from Neovim.
+   * Only meaningful inside notification and request handlers, which
+   * run on the thread that reads the output.
+   */
+  std::chrono::steady_clock::time_point read_time() const { return last_read; }
   template<typename T>
   void ui_set_option(const std::string& name, T&& val);
   void set_client_info(const ClientInfo& info);
@@ -233,6 +248,9 @@ private:
   std::atomic<bool> did_exit = false;
   // Condition variable to check if we are closing
   std::atomic<bool> closed;
+  bool detached = false;
+  /// Only used by the output reading thread.
+  std::chrono::steady_clock::time_point last_read;
   std::mutex input_mutex;
   std::mutex notification_handlers_mutex;
   std::mutex request_handlers_mutex;
@@ -258,6 +276,7 @@ private:
 template<typename T>
 void Nvim::send_request(const std::string& method, T&& params)
 {
+  if (detached) return;
   std::unique_lock<std::mutex> lock {input_mutex};
   const std::uint64_t msg_type = Type::Request;
   msgpack::sbuffer sbuf;
@@ -280,6 +299,7 @@ void Nvim::send_request(const std::string& method, T&& params)
 template<typename T>
 void Nvim::send_notification(const std::string& method, T&& params)
 {
+  if (detached) return;
   // Same deal as Nvim::send_request, but for a notification this time
   std::unique_lock<std::mutex> lock {input_mutex};
   const std::uint64_t msg_type = Type::Notification;
@@ -303,6 +323,7 @@ void Nvim::send_response(
   Err&& err
 )
 {
+  if (detached) return;
   std::unique_lock<std::mutex> lock {input_mutex};
   const std::uint64_t type = Type::Response;
   const auto msg = std::tuple {
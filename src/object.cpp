@@ -58,6 +58,36 @@ std::string Object::to_string() const noexcept
   return ss.str();
 }
 
+void Object::to_msgpack(msgpack::packer<msgpack::sbuffer>& pk) const
+{
+  std::visit(overloaded {
+    [&](const std::monostate&) { pk.pack_nil(); },
+    [&](const std::string& s) { pk.pack(s); },
+    [&](const int64_t& i) { pk.pack(i); },
+    [&](const uint64_t& u) { pk.pack(u); },
+    [&](const ObjectArray& arr) {
+      pk.pack_array(static_cast<std::uint32_t>(arr.size()));
+      for(const auto& o : arr) o.to_msgpack(pk);
+    },
+    [&](const ObjectMap& mp) {
+      pk.pack_map(static_cast<std::uint32_t>(mp.size()));
+      for(const auto& [k, val] : mp)
+      {
+        pk.pack(k);
+        val.to_msgpack(pk);
+      }
+    },
+    [&](const NeovimExt& ext) {
+      const auto size = static_cast<std::uint32_t>(ext.data.size());
+      pk.pack_ext(size, ext.type);
+      pk.pack_ext_body(ext.data.constData(), size);
+    },
+    [&](const bool& b) { pk.pack(b); },
+    [&](const double& d) { pk.pack(d); },
+    [&](const Error&) { pk.pack_nil(); }
+  }, v);
+}
+
 /// Visitor that satisfies msgpack's visitor requirements
 /// that parses messagepack data to an Object.
 /// The final object is stored in "result".
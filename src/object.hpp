@@ -71,6 +71,10 @@ struct Object
   /// it's better to use Object::from_msgpack
   static Object parse(const msgpack::object&);
   std::string to_string() const noexcept;
+  /// Serializes the Object back to messagepack.
+  /// Ext objects are packed with their original type and data,
+  /// and Error objects are packed as nil.
+  void to_msgpack(msgpack::packer<msgpack::sbuffer>& packer) const;
   auto* array() noexcept { return std::get_if<Array>(&v); }
   auto* string() noexcept { return std::get_if<string_type>(&v); }
   auto* i64() noexcept { return std::get_if<int64_t>(&v); }
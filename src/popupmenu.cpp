@@ -1,16 +1,20 @@
 #include "nvim.hpp"
 #include "popupmenu.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <QFile>
 #include <QPainter>
 #include <QStaticText>
 #include <QStringBuilder>
 #include <QStringLiteral>
+#include <string_view>
 #include "cmdline.hpp"
 #include "hlstate.hpp"
 #include "nvim_utils.hpp"
 #include "utils.hpp"
 
-QString PopupMenuIconManager::kind_to_iname(QString kind)
+QString PopupMenuIconManager::kind_to_iname(QString kind) const
 {
   if (kind.size() <= 0) return QString();
   int ws_index = kind.indexOf(' ');
@@ -48,34 +52,66 @@ static std::pair<QColor, QColor> find_or_default(
   else return {default_fg, default_bg};
 }
 
-QPixmap PopupMenuIconManager::load_icon(const QString& iname, int width)
+void PopupMenuIconManager::load_renderers()
 {
-  auto&& [fg, bg] = find_or_default(colors, iname, default_fg, default_bg);
-  auto&& px = pixmap_from_svg(
-    constants::picon_fp() % iname % ".svg",
-    fg,
-    Qt::transparent,
-    width, width
-  );
-  return px.value_or(QPixmap());
+  const auto keys = colors.keys();
+  for(const auto& iname : keys)
+  {
+    QFile file {constants::picon_fp() % iname % ".svg"};
+    if (!file.open(QIODevice::ReadOnly)) continue;
+    renderers[iname] = std::make_shared<QSvgRenderer>(file.readAll());
+  }
 }
 
-void PopupMenuIconManager::load_icons(int width)
+QPixmap PopupMenuIconManager::render_icon(
+  const QString& iname,
+  const QColor& fg
+) const
 {
-  auto keys = icons.keys();
-  for(auto& key : keys)
-  {
-    icons[key] = load_icon(key, width);
-  }
+  const auto it = renderers.find(iname);
+  if (it == renderers.end() || !(*it)->isValid()) return QPixmap();
+  QPixmap pm {sq_width, sq_width};
+  if (pm.isNull()) return pm;
+  pm.fill(Qt::transparent);
+  QPainter p(&pm);
+  (*it)->render(&p);
+  p.setCompositionMode(QPainter::CompositionMode_SourceIn);
+  p.fillRect(pm.rect(), fg);
+  return pm;
 }
 
-const QPixmap* PopupMenuIconManager::icon_for_kind(const QString& kind)
+const QPixmap* PopupMenuIconManager::raster(
+  const QString& iname,
+  const QColor& fg
+)
 {
-  if (kind.isEmpty()) return &icons["key"];
+  IconKey key {iname, sq_width, fg.rgba()};
+  if (auto* pm = rasters.get(key)) return pm;
+  QPixmap pm = render_icon(iname, fg);
+  return &rasters.put(std::move(key), std::move(pm));
+}
+
+QString PopupMenuIconManager::icon_name_for(const QString& kind) const
+{
+  if (kind.isEmpty()) return QStringLiteral("key");
   QString iname = kind_to_iname(kind).trimmed();
-  const auto it = icons.find(iname);
-  if (it == icons.end()) return &icons["key"];
-  else return &(*it);
+  if (!renderers.contains(iname)) return QStringLiteral("key");
+  return iname;
+}
+
+const QPixmap* PopupMenuIconManager::icon_for_kind(const QString& kind)
+{
+  const QString iname = icon_name_for(kind);
+  const auto fg = find_or_default(colors, iname, default_fg, default_bg).first;
+  return raster(iname, fg);
+}
+
+const QPixmap* PopupMenuIconManager::icon_for_kind(
+  const QString& kind,
+  const QColor& fg
+)
+{
+  return raster(icon_name_for(kind), fg);
 }
 
 PopupMenu::PopupMenu(const HLState* state)
@@ -107,10 +143,19 @@ void PopupMenu::pum_sel(std::span<const Object> objs)
   const auto& obj = objs.back();
   auto* arr = obj.array();
   assert(arr && arr->size() >= 1);
-  if (cur_selected >= 0) completion_items[cur_selected].selected = false;
+  const int previous = cur_selected;
   cur_selected = static_cast<int>(arr->at(0));
-  if (cur_selected >= 0) completion_items[cur_selected].selected = true;
-  redraw();
+  if (locally_filtered)
+  {
+    // Neovim's index is into its own list
+    const auto it = std::find(
+      shown_sources.begin(), shown_sources.end(), std::uint32_t(cur_selected)
+    );
+    cur_selected = it == shown_sources.end()
+      ? -1 : int(it - shown_sources.begin());
+  }
+  if (cur_selected >= int(completion_items.size())) cur_selected = -1;
+  selection_changed(previous);
 }
 
 void PopupMenu::pum_hide(std::span<const Object>)
@@ -134,12 +179,20 @@ void PopupMenu::pum_show(
   longest_word_size = 0;
   is_hidden = false;
   completion_items.clear();
+  item_text.clear();
   add_items(items);
-  if (selected >= 0 && selected < int(completion_items.size()))
+  locally_filtered = false;
+  query.clear();
+  if (fuzzy)
   {
-    completion_items[selected].selected = true;
+    source_items = completion_items;
+    fuzzy_index.clear();
+    fuzzy_index.reserve(source_items.size(), item_text.size());
+    for(const auto& item : source_items) fuzzy_index.add(view_of(item.word));
   }
+  if (selected >= int(completion_items.size())) selected = -1;
   cur_selected = selected;
+  first_visible = 0;
   row = p_row;
   col = p_col;
   grid_num = p_grid_num;
@@ -161,22 +214,102 @@ void PopupMenu::pum_show(
   do_show();
 }
 
+/// Number of UTF-16 code units the UTF-8 string takes up
+/// (which is what QString::size() would give), without converting it.
+static int utf16_length(std::string_view s)
+{
+  int length = 0;
+  for(const auto c : s)
+  {
+    const auto byte = static_cast<unsigned char>(c);
+    // Continuation bytes don't start a new code point, and code points
+    // outside the BMP (4-byte sequences) take two UTF-16 code units.
+    if ((byte & 0xC0) != 0x80) ++length;
+    if (byte >= 0xF0) ++length;
+  }
+  return length;
+}
+
 void PopupMenu::add_items(const ObjectArray& items)
 {
+  completion_items.reserve(items.size());
+  const auto append = [&](const Object& obj) -> PMenuItem::Slice {
+    const auto* str = obj.string();
+    if (!str) return {};
+    PMenuItem::Slice slice {
+      static_cast<std::uint32_t>(item_text.size()),
+      static_cast<std::uint32_t>(str->size())
+    };
+    item_text.append(*str);
+    return slice;
+  };
   for(const auto& item : items)
   {
-    const auto& arr = item.array_ref();
-    auto word = QString::fromStdString(arr[0].string_ref());
-    auto kind = QString::fromStdString(arr[1].string_ref());
-    auto menu = QString::fromStdString(arr[2].string_ref());
-    auto info = QString::fromStdString(arr[3].string_ref());
-    longest_word_size = std::max(longest_word_size, word.size());
+    const auto* arr = item.array();
+    if (!arr || arr->size() < 4) continue;
+    if (const auto* word = arr->at(0).string())
+    {
+      longest_word_size = std::max(longest_word_size, utf16_length(*word));
+    }
     completion_items.push_back({
-      false, std::move(word), std::move(kind), std::move(menu), std::move(info)
+      append(arr->at(0)), append(arr->at(1)),
+      append(arr->at(2)), append(arr->at(3))
     });
   }
 }
 
+void PopupMenu::set_fuzzy_enabled(bool enabled)
+{
+  fuzzy = enabled;
+  if (fuzzy) return;
+  fuzzy_index.clear();
+  source_items = {};
+  shown_sources = {};
+}
+
+void PopupMenu::filter_typed(std::string_view typed)
+{
+  if (!fuzzy || is_hidden || cmdline || source_items.empty()) return;
+  query.append(typed);
+  apply_filter();
+}
+
+void PopupMenu::filter_backspace()
+{
+  if (!fuzzy || is_hidden || cmdline || source_items.empty()) return;
+  if (query.empty()) return;
+  // Remove the whole last UTF-8 sequence
+  while(!query.empty()
+    && (static_cast<unsigned char>(query.back()) & 0xC0) == 0x80)
+  {
+    query.pop_back();
+  }
+  if (!query.empty()) query.pop_back();
+  apply_filter();
+}
+
+void PopupMenu::apply_filter()
+{
+  const auto matches = fuzzy_index.filter(query);
+  completion_items.clear();
+  shown_sources.clear();
+  longest_word_size = 0;
+  for(const auto& match : matches)
+  {
+    const auto& item = source_items[match.index];
+    completion_items.push_back(item);
+    shown_sources.push_back(match.index);
+    longest_word_size = std::max(
+      longest_word_size, utf16_length(view_of(item.word))
+    );
+  }
+  locally_filtered = true;
+  cur_selected = -1;
+  first_visible = 0;
+  update_dimensions();
+  redraw();
+}
+
 void PopupMenu::update_highlight_attributes()
 {
   pmenu = &hl_state->attr_for_id(hl_state->id_for_name("Pmenu"));
@@ -230,7 +363,11 @@ QRect PopupMenu::calc_rect(int width, int height, int max_x, int max_y) const
 }
 
 PopupMenuQ::PopupMenuQ(const HLState* state, QWidget* parent)
-  : PopupMenu(state), QWidget(parent), icon_manager(10), metrics(font())
+  : PopupMenu(state),
+    QWidget(parent),
+    icon_manager(10),
+    text_cache(text_cache_size, text_cache_bytes),
+    metrics(font())
 {
   hide();
 }
@@ -258,34 +395,117 @@ void PopupMenuQ::paint()
     hide();
     return;
   }
+  scroll_to_selected();
   QPainter p(&pixmap);
   p.setFont(pmenu_font);
-  int pad = border_width;
-  int cur_y = pad;
-  bool nothing_selected = cur_selected == -1;
-  if (nothing_selected) cur_selected = 0;
-  int maxitems = max_items();
-  for(int i = 0; i < maxitems; ++i)
+  // Only the rows that fit are converted and drawn
+  const int rows = std::min(max_items(), rows_shown());
+  for(int row = 0; row < rows; ++row) paint_row(p, row);
+  painted_selected = cur_selected;
+  painted_colors = pmenu_colors();
+  pixmap_current = true;
+  update();
+}
+
+std::array<uint32, 4> PopupMenuQ::pmenu_colors() const
+{
+  const auto normal = hl_state->colors_for(*pmenu);
+  const auto selected = hl_state->colors_for(*pmenu_sel);
+  return {
+    normal.fg.to_uint32(), normal.bg.to_uint32(),
+    selected.fg.to_uint32(), selected.bg.to_uint32()
+  };
+}
+
+void PopupMenuQ::selection_changed(int previous)
+{
+  if (completion_items.empty() || !pixmap_current
+      || previous != painted_selected || pmenu_colors() != painted_colors)
   {
-    int index = (cur_selected + i) % completion_items.size();
-    const auto& item = completion_items.at(index);
-    if (item.selected)
+    paint();
+    return;
+  }
+  const int rows = std::min(max_items(), rows_shown());
+  const int old_first = first_visible;
+  scroll_to_selected();
+  const int delta = first_visible - old_first;
+  if (std::abs(delta) >= rows)
+  {
+    paint();
+    return;
+  }
+  const int h = item_height();
+  const int pad = border_width;
+  const int kept = rows - std::abs(delta);
+  // Copied before painting starts, the source and destination overlap
+  const QPixmap moved = delta != 0
+    ? pixmap.copy(0, pad + std::max(delta, 0) * h, pixmap.width(), kept * h)
+    : QPixmap();
+  QPainter p(&pixmap);
+  p.setFont(pmenu_font);
+  if (delta != 0)
+  {
+    // Move the rows that stay visible, then paint the ones scrolled in
+    p.drawPixmap(QPoint {0, pad + std::max(-delta, 0) * h}, moved);
+    const int exposed_start = delta > 0 ? kept : 0;
+    for(int row = exposed_start; row < exposed_start + std::abs(delta); ++row)
     {
-      draw_with_attr(p, *pmenu_sel, item, cur_y);
+      paint_row(p, row);
     }
-    else
+  }
+  // Only the rows whose selection state changed
+  for(const int index : {previous, cur_selected})
+  {
+    const int row = index - first_visible;
+    if (index >= 0 && row >= 0 && row < rows) paint_row(p, row);
+  }
+  painted_selected = cur_selected;
+  update();
+}
+
+int PopupMenuQ::rows_shown() const
+{
+  const int rows = (height() - 2 * int(border_width)) / item_height();
+  return std::max(rows, 1);
+}
+
+void PopupMenuQ::scroll_to_selected()
+{
+  const int rows = std::min(max_items(), rows_shown());
+  const int count = int(completion_items.size());
+  if (cur_selected >= 0)
+  {
+    if (cur_selected < first_visible) first_visible = cur_selected;
+    else if (cur_selected >= first_visible + rows)
     {
-      draw_with_attr(p, *pmenu, item, cur_y);
+      first_visible = cur_selected - rows + 1;
     }
-    cur_y += item_height();
   }
-  if (nothing_selected) cur_selected = -1;
-  update();
+  first_visible = std::clamp(first_visible, 0, std::max(count - rows, 0));
+}
+
+void PopupMenuQ::paint_row(QPainter& p, int row)
+{
+  const int y = int(border_width) + row * item_height();
+  const int index = first_visible + row;
+  if (index >= int(completion_items.size()))
+  {
+    const auto bg = hl_state->colors_for(*pmenu).bg;
+    p.fillRect(0, y, pixmap.width(), item_height(), bg.qcolor());
+    return;
+  }
+  const bool selected = index == cur_selected;
+  const auto& item = completion_items[index];
+  draw_with_attr(p, selected ? *pmenu_sel : *pmenu, item, selected, y);
 }
 
 void PopupMenuQ::font_changed(const QFont& font, FontDimensions dims)
 {
-  text_cache.clear();
+  if (font != text_cache_font)
+  {
+    text_cache.clear();
+    text_cache_font = font;
+  }
   update_highlight_attributes();
   pmenu_font = font;
   dimensions = dims;
@@ -296,46 +516,49 @@ void PopupMenuQ::font_changed(const QFont& font, FontDimensions dims)
   update_dimensions();
 }
 
-void PopupMenuQ::draw_with_attr(QPainter& p, const HLAttr& attr, const PMenuItem& item, int y)
+void PopupMenuQ::draw_with_attr(
+  QPainter& p,
+  const HLAttr& attr,
+  const PMenuItem& item,
+  bool selected,
+  int y
+)
 {
   //float offset = font_ascent + (linespace / 2.f);
   auto [fg, bg, sp] = attr.fg_bg_sp(hl_state->default_colors_get());
   font::set_opts(pmenu_font, attr.font_opts);
   p.setFont(pmenu_font);
-  const auto* icon_ptr = cmdline ? nullptr : icon_manager.icon_for_kind(item.kind);
+  const QString kind = cmdline ? QString() : text_of(item.kind);
+  // Selected icons are drawn in the selected item's foreground colour
+  const QPixmap* icon_ptr = nullptr;
+  if (!cmdline && icons_enabled)
+  {
+    icon_ptr = selected
+      ? icon_manager.icon_for_kind(kind, fg.qcolor())
+      : icon_manager.icon_for_kind(kind);
+  }
   int left = std::ceil(border_width);
   p.fillRect(left, y, pixmap.width(), item_height(), bg.qcolor());
   if (icon_ptr && icons_enabled)
   {
     int height = item_height();
-    auto icon_bg = icon_manager.bg_for_kind(item.kind);
+    auto icon_bg = icon_manager.bg_for_kind(kind);
     if (icon_bg) p.fillRect(QRect {left, y, height, height}, *icon_bg);
-    if (item.selected)
-    {
-      // Blend pixmap in with selected color
-      QPixmap clone = *icon_ptr;
-      QPainter pixmap_painter(&clone);
-      pixmap_painter.setCompositionMode(QPainter::CompositionMode_SourceIn);
-      pixmap_painter.fillRect(clone.rect(), fg.qcolor());
-      pixmap_painter.end();
-      p.drawPixmap(QPoint {left, y}, clone);
-    }
-    else
-    {
-      p.drawPixmap(QPoint {left, y}, *icon_ptr);
-    }
+    p.drawPixmap(QPoint {left, y}, *icon_ptr);
     left += icon_ptr->width() * icon_space;
   }
   p.setPen(fg.qcolor());
-  auto it = text_cache.find(item.word);
-  if (it == text_cache.end())
+  const QString word = text_of(item.word);
+  const auto key = qMakePair(word, attr.font_opts);
+  QStaticText* static_text = text_cache.get(key);
+  if (!static_text)
   {
-    it = text_cache.insert(item.word, QStaticText {item.word});
-    it->setPerformanceHint(QStaticText::AggressiveCaching);
-    it->prepare(QTransform(), pmenu_font);
+    static_text = &text_cache.put(key, QStaticText {word});
+    static_text->setPerformanceHint(QStaticText::AggressiveCaching);
+    static_text->prepare(QTransform(), pmenu_font);
   }
   int off = (item_height() - dimensions.height + linespace) / 2;
-  p.drawStaticText(left, y + off, *it);
+  p.drawStaticText(left, y + off, *static_text);
 }
 
 PopupMenu::Rectangle
@@ -364,7 +587,6 @@ void PopupMenuQ::paintEvent(QPaintEvent*)
 
 void PopupMenuQ::update_dimensions()
 {
-  text_cache.clear();
   auto w_adv = metrics.horizontalAdvance('W');
   double text_width = longest_word_size * w_adv;
   int user_max_width = max_chars ? max_chars * w_adv : INT_MAX;
@@ -406,6 +628,7 @@ void PopupMenuQ::update_dimensions()
     pixmap = QPixmap(width, height);
   }
   resize(width, height);
+  pixmap_current = false;
   if (pmenu) pixmap.fill(hl_state->colors_for(*pmenu).bg.qcolor());
 }
 
@@ -480,6 +703,9 @@ void PopupMenuQ::register_nvim(Nvim& nvim)
     if (items <= 0) item_limit = 0;
     else item_limit = items;
   }));
+  on("NVUI_PUM_FUZZY", paramify<bool>([this](bool enabled) {
+    set_fuzzy_enabled(enabled);
+  }));
   using namespace std;
   handle_request<vector<string>, string>(nvim, "NVUI_POPUPMENU_ICON_NAMES",
     [&](const auto&) {
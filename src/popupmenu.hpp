@@ -1,5 +1,7 @@
 #ifndef NVUI_POPUPMENU_HPP
 #define NVUI_POPUPMENU_HPP
+#include <array>
+#include <memory>
 #include <optional>
 #include <QWidget>
 #include <QCompleter>
@@ -7,7 +9,10 @@
 #include <QPaintEvent>
 #include <QStaticText>
 #include <QStringBuilder>
+#include <QSvgRenderer>
 #include <span>
+#include <string>
+#include <string_view>
 #include <msgpack.hpp>
 #include "hlstate.hpp"
 #include "object.hpp"
@@ -16,38 +21,60 @@
 #include <fmt/format.h>
 #include "constants.hpp"
 #include "font.hpp"
+#include "fuzzy.hpp"
+#include "lru.hpp"
+#include "shared_fonts.hpp"
+
+/// A rasterized popup menu icon.
+struct IconKey
+{
+  QString iname;
+  int size = 0;
+  QRgb fg = 0;
+  bool operator==(const IconKey&) const = default;
+};
+
+inline std::size_t qHash(const IconKey& key, std::size_t seed = 0)
+{
+  return qHash(key.iname, uint(seed))
+    ^ qHash((quint64(quint32(key.size)) << 32) | key.fg);
+}
 
 /// Manages the popup menu icons and gives the appropriate
 /// icon for each popup menu item kind (useful for LSP).
-/// Icons are square
+/// Icons are square.
+/// Each SVG is parsed once, when the manager is created. Icons are
+/// rasterized when they're first drawn and cached by (kind, size,
+/// colour), so changing the size or colours doesn't render anything
+/// until the icons are drawn again.
+/// The icon background is filled separately (see bg_for_kind),
+/// so it isn't part of the rasterization.
 class PopupMenuIconManager
 {
 public:
   using color_opt = std::optional<QColor>;
   using fg_bg = std::pair<color_opt, color_opt>;
   PopupMenuIconManager(int pm_size)
-    : sq_width(pm_size)
+    : sq_width(pm_size),
+      rasters(icon_cache_size)
   {
-    load_icons(pm_size);
+    load_renderers();
   }
 
-  void size_changed(int new_size)
-  {
-    if (sq_width == new_size) return;
-    sq_width = new_size;
-    load_icons(sq_width);
-  }
+  void size_changed(int new_size) { sq_width = new_size; }
 
+  /// Icon for kind in its foreground colour.
+  /// The pointer is valid until the next call to icon_for_kind.
   const QPixmap* icon_for_kind(const QString& kind);
+  /// Icon for kind in the given colour (used for the selected item).
+  const QPixmap* icon_for_kind(const QString& kind, const QColor& fg);
   inline void set_default_fg(QColor fg)
   {
     default_fg = std::move(fg);
-    load_icons(sq_width);
   }
   inline void set_default_bg(QColor bg)
   {
     default_bg = std::move(bg);
-    load_icons(sq_width);
   }
 
   inline void set_bg_for_name(const QString& name, QColor bg)
@@ -56,7 +83,6 @@ public:
     if (colors.contains(name)) pair = colors[name];
     pair.second = std::move(bg);
     colors[name] = pair;
-    update_icon(name);
   }
 
   inline void set_fg_for_name(const QString& name, QColor fg)
@@ -65,25 +91,17 @@ public:
     if (colors.contains(name)) pair = colors[name];
     pair.first = fg;
     colors[name] = pair;
-    update_icon(name);
   }
 
   inline void set_fg_bg_for_name(const QString& name, QColor fg, QColor bg)
   {
     colors[name] = {std::move(fg), std::move(bg)};
-    update_icon(name);
-  }
-
-  inline void update_icon(const QString& name)
-  {
-    if (!icons.contains(name)) return;
-    else icons[name] = load_icon(name, sq_width);
   }
 
   std::vector<std::string> icon_list() const
   {
     std::vector<std::string> vs;
-    const auto keys = icons.keys();
+    const auto keys = renderers.keys();
     for(const auto& icon_name : keys)
     {
       vs.push_back(icon_name.toStdString());
@@ -100,11 +118,15 @@ public:
   }
 
   int icon_size() const { return sq_width; }
+  /// Hit/miss statistics of the rasterized icons.
+  const auto& icon_cache_stats() const { return rasters.stats(); }
 private:
-  QPixmap load_icon(const QString& iname, int width);
-  void load_icons(int width);
+  void load_renderers();
+  QPixmap render_icon(const QString& iname, const QColor& fg) const;
+  const QPixmap* raster(const QString& iname, const QColor& fg);
+  QString icon_name_for(const QString& kind) const;
   QString iname_to_kind(const QString& iname);
-  QString kind_to_iname(QString kind);
+  QString kind_to_iname(QString kind) const;
   // Map string (iname) to (foreground, background) tuple
   // Any color with no value will default to the default_foreground and default_background
   // colors.
@@ -139,49 +161,31 @@ private:
     {"structure", {}},
     {"variable", {}}
   };
-  QHash<QString, QPixmap> icons {
-    {"array", {}},
-    {"boolean", {}},
-    {"class", {}},
-    {"color", {}},
-    {"constant", {}},
-    {"constructor", {}},
-    {"enum-member", {}},
-    {"enum", {}},
-    {"event", {}},
-    {"field", {}},
-    {"function", {}},
-    {"file", {}},
-    {"interface", {}},
-    {"key", {}},
-    {"keyword", {}},
-    {"method", {}},
-    {"misc", {}},
-    {"module", {}},
-    {"namespace", {}},
-    {"numeric", {}},
-    {"operator", {}},
-    {"parameter", {}},
-    {"property", {}},
-    {"reference", {}},
-    {"ruler", {}},
-    {"snippet", {}},
-    {"string", {}},
-    {"structure", {}},
-    {"variable", {}}
-  };
+  /// Parsed SVG of each icon, keyed by icon name.
+  QHash<QString, std::shared_ptr<QSvgRenderer>> renderers;
+  /// Enough for every icon in a few sizes and colours.
+  static constexpr std::size_t icon_cache_size = 256;
+  LRUCache<IconKey, QPixmap> rasters;
   int sq_width = 0;
   QColor default_fg = Qt::blue;
   QColor default_bg = Qt::transparent;
 };
 
+/// A completion item. Its text is kept as UTF-8 in the popup menu's
+/// item text buffer, and only converted to QString for the rows that
+/// are actually drawn (LSP servers can send tens of thousands of items).
 struct PMenuItem
 {
-  bool selected = false;
-  QString word;
-  QString kind;
-  QString menu;
-  QString info;
+  /// A range of bytes in PopupMenu::item_text.
+  struct Slice
+  {
+    std::uint32_t offset = 0;
+    std::uint32_t size = 0;
+  };
+  Slice word;
+  Slice kind;
+  Slice menu;
+  Slice info;
 };
 
 class Nvim;
@@ -270,6 +274,21 @@ public:
 
   auto selected_idx() { return cur_selected; }
 
+  /**
+   * Client-side fuzzy filtering (:NvuiPopupMenuFuzzy).
+   * When enabled, the words of the last list Neovim sent are kept in an
+   * index, and typing filters and ranks them right away, before Neovim
+   * sends the updated list (which then replaces the filtered one).
+   */
+  void set_fuzzy_enabled(bool enabled);
+  bool fuzzy_enabled() const { return fuzzy; }
+  /// The text being completed when the menu was shown.
+  void set_completion_base(std::string base) { query = std::move(base); }
+  /// Filter by the completion base plus the text typed since.
+  void filter_typed(std::string_view typed);
+  /// Filter by the completion base without its last character.
+  void filter_backspace();
+
   struct Rectangle
   {
     int x;
@@ -289,10 +308,26 @@ protected:
    * Add the given popupmenu items to the popup menu.
    */
   void add_items(const ObjectArray& items);
+  /// Filter the last list from Neovim by query and show the result.
+  void apply_filter();
+  std::string_view view_of(PMenuItem::Slice slice) const
+  {
+    return std::string_view(item_text).substr(slice.offset, slice.size);
+  }
+  /// The text of an item's slice.
+  QString text_of(PMenuItem::Slice slice) const
+  {
+    return QString::fromUtf8(item_text.data() + slice.offset, int(slice.size));
+  }
   /**
    * Redraw the popupmenu.
    */
   virtual void redraw() = 0;
+  /**
+   * Called when the selection changed from previous to cur_selected
+   * (popupmenu_select). Redraws the whole menu by default.
+   */
+  virtual void selection_changed(int previous) { Q_UNUSED(previous); redraw(); }
   // Optional attached command line.
   // When this is not nullptr,
   // indicates the popup menu should be attached to
@@ -309,8 +344,13 @@ protected:
   const HLAttr* pmenu_thumb = nullptr;
   Color border_color {0, 0, 0};
   int cur_selected = -1;
+  /// Index of the item shown in the first row.
+  int first_visible = 0;
   float font_ascent = 0.f;
   std::vector<PMenuItem> completion_items;
+  /// The text of every completion item, back to back.
+  /// Cleared (but not freed) on every show.
+  std::string item_text;
   int grid_num = 0;
   int row = 0;
   int col = 0;
@@ -320,6 +360,15 @@ protected:
   bool is_hidden = true;
   float border_width = 1.f;
   int longest_word_size = 0;
+  bool fuzzy = false;
+  /// Whether completion_items is a local filter of source_items.
+  bool locally_filtered = false;
+  FuzzyIndex fuzzy_index;
+  /// The last list Neovim sent, when fuzzy filtering is enabled.
+  std::vector<PMenuItem> source_items;
+  /// Index in source_items of each filtered item.
+  std::vector<std::uint32_t> shown_sources;
+  std::string query;
 };
 
 class PopupMenuQ : public PopupMenu, public QWidget
@@ -357,37 +406,54 @@ public:
   {
     if (space < 1.0f) return;
     icon_space = space;
+    pixmap_current = false;
   }
 
   inline void set_icon_fg(const QString& icon_name, QColor fg)
   {
     icon_manager.set_fg_for_name(icon_name, std::move(fg));
+    pixmap_current = false;
   }
 
   inline void set_icon_bg(const QString& icon_name, QColor bg)
   {
     icon_manager.set_bg_for_name(icon_name, std::move(bg));
+    pixmap_current = false;
   }
 
   inline void set_icon_colors(const QString& icon_name, QColor fg, QColor bg)
   {
     icon_manager.set_fg_bg_for_name(icon_name, std::move(fg), std::move(bg));
+    pixmap_current = false;
   }
 
   inline void set_default_icon_fg(QColor fg)
   {
     icon_manager.set_default_fg(std::move(fg));
+    pixmap_current = false;
   }
 
   inline void set_default_icon_bg(QColor bg)
   {
     icon_manager.set_default_bg(std::move(bg));
+    pixmap_current = false;
   }
   void draw_with_attr(
     QPainter& p, const HLAttr& attr,
-    const PMenuItem& item, int y
+    const PMenuItem& item, bool selected, int y
   );
   Rectangle dimensions_for(int x, int y, int w, int h) override;
+  /// Hit/miss statistics of the completion word cache.
+  const auto& text_cache_stats() const { return text_cache.stats(); }
+  /// Hit/miss statistics of the rasterized icons.
+  const auto& icon_cache_stats() const
+  {
+    return icon_manager.icon_cache_stats();
+  }
+  /// Number of words in the completion word cache.
+  std::size_t text_cache_entries() const { return text_cache.size(); }
+  /// Estimated memory held by the completion word cache.
+  std::size_t text_cache_memory() const { return text_cache.bytes(); }
 protected:
   void paintEvent(QPaintEvent*) override;
 private:
@@ -397,18 +463,41 @@ private:
   void do_hide() override;
   void do_show() override;
   void redraw() override;
+  void selection_changed(int previous) override;
   void update_dimensions() override;
   void paint();
+  /// Number of rows that fit in the popup menu.
+  int rows_shown() const;
+  /// Scroll so that the selected item is visible.
+  void scroll_to_selected();
+  /// Paint the item in the given row (relative to first_visible).
+  void paint_row(QPainter& p, int row);
   int max_chars = 0;
   int item_limit = 0;
   QPixmap pixmap;
+  /// The selected item when the pixmap was last painted.
+  int painted_selected = -1;
+  /// False when the pixmap was cleared or resized since the last paint.
+  bool pixmap_current = false;
+  /// Pmenu and PmenuSel colours the pixmap was painted with.
+  std::array<uint32, 4> painted_colors {};
+  std::array<uint32, 4> pmenu_colors() const;
   PopupMenuIconManager icon_manager;
   bool icons_enabled = true;
   float icon_space = 1.1f;
   int icon_size_offset = 0;
   QFont pmenu_font;
   FontDimensions dimensions {1, 1};
-  QHash<QString, QStaticText> text_cache;
+  /// Prepared completion words, keyed by the word and its font options.
+  /// Persists across popups and is only cleared when the font changes
+  /// (the pen colour isn't part of a QStaticText).
+  /// Bounded so that long sessions (e.g. LSP completion in a big
+  /// codebase) don't keep every word that was ever shown.
+  static constexpr std::size_t text_cache_size = 4096;
+  static constexpr std::size_t text_cache_bytes = 4 * 1024 * 1024;
+  TextCache text_cache;
+  /// The font the text cache was prepared with.
+  QFont text_cache_font;
   QFontMetricsF metrics;
 };
 
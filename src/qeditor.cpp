@@ -1,17 +1,22 @@
 #include "qeditor.hpp"
 #include "qpaintgrid.hpp"
 #include "font.hpp"
+#include "font_metrics_cache.hpp"
 #include <QApplication>
 #include <QEvent>
+#include <QPaintEvent>
+#include <QScreen>
+#include <algorithm>
+
+/// Parameters for sizing the fallback fonts relative to the main font.
+static constexpr double relative_tolerance = 0.0001;
+static constexpr std::size_t relative_iterations = 1000;
 
 /**
  * Sets relative's point size to a point size that is such that the horizontal
  * advance of the character 'a' is within tolerance of the target's horizontal
  * advance for the same character.
- * This is done using a binary search algorithm between
- * (0, target.pointSizeF() * 2.). The algorithm runs in a loop, the number
- * of times can be limited using max_iterations. If max_iterations is 0
- * the loop will run without stopping until it is within error.
+ * See FontMetricsCache::relative_point_size.
  */
 static void set_relative_font_size(
   const QFont& target,
@@ -19,28 +24,10 @@ static void set_relative_font_size(
   const double tolerance,
   const std::size_t max_iterations
 )
-{ 
-  constexpr auto width = [](const QFontMetricsF& m) {
-    return m.horizontalAdvance('a');
-  };
-  QFontMetricsF target_metrics {target};
-  const double target_width = width(target_metrics);
-  double low = 0.;
-  double high = target.pointSizeF() * 2.;
-  modified.setPointSizeF(high);
-  for(u32 rep = 0;
-      (rep < max_iterations || max_iterations == 0) && low <= high;
-      ++rep)
-  {
-    double mid = (low + high) / 2.;
-    modified.setPointSizeF(mid);
-    QFontMetricsF metrics {modified};
-    const double diff =  target_width - width(metrics);
-    if (std::abs(diff) <= tolerance) return;
-    if (diff < 0) /** point size too big */ high = mid;
-    else if (diff > 0) /** point size too low */ low = mid;
-    else return;
-  }
+{
+  modified.setPointSizeF(FontMetricsCache::instance().relative_point_size(
+    target, modified, tolerance, max_iterations
+  ));
 }
 
 QEditor::QEditor(
@@ -65,6 +52,15 @@ QEditor::QEditor(
   setFocusPolicy(Qt::StrongFocus);
   setFocus();
   setMouseTracking(true);
+  frame_timer.setSingleShot(true);
+  frame_timer.setTimerType(Qt::PreciseTimer);
+  frame_timer.callOnTimeout([this] {
+    // If the editor can't be painted (e.g. it's minimized) the next
+    // flush must still be able to schedule a frame.
+    frame_scheduled = false;
+    update();
+  });
+  shared = SharedFonts::acquire({});
 }
 
 QEditor::~QEditor() = default;
@@ -137,7 +133,39 @@ void QEditor::keyPressEvent(QKeyEvent* ev)
   Base::handle_key_press(ev);
 }
 
-void QEditor::redraw() { update(); }
+int QEditor::frame_interval_ms() const
+{
+  constexpr double default_refresh_rate = 60.;
+  const auto* scr = screen();
+  double rate = scr ? scr->refreshRate() : default_refresh_rate;
+  if (rate <= 0.) rate = default_refresh_rate;
+  return std::max(1, int(1000. / rate));
+}
+
+void QEditor::redraw()
+{
+  // Hidden and minimized editors get a full paint when they're shown
+  // again, which processes everything that came in meanwhile.
+  if (!isVisible() || window()->isMinimized()) return;
+  // Grid state has already been updated, it'll show up in the
+  // frame that's already scheduled.
+  if (frame_scheduled)
+  {
+    ++frames_skipped;
+    ++pending_skipped;
+    return;
+  }
+  frame_scheduled = true;
+  const auto interval = frame_interval_ms();
+  if (!since_last_frame.isValid() || since_last_frame.elapsed() >= interval)
+  {
+    update();
+  }
+  else
+  {
+    frame_timer.start(interval - int(since_last_frame.elapsed()));
+  }
+}
 
 void QEditor::linespace_changed(float)
 {
@@ -161,8 +189,7 @@ static void set_fontdesc(QFont& font, const FontDesc& fdesc)
 void QEditor::set_fonts(std::span<FontDesc> fontdescs)
 {
   if (fontdescs.empty()) return;
-  fallback_indices.clear();
-  fonts.clear();
+  font_list.clear();
   QFontDatabase font_db;
   set_fontdesc(first_font, fontdescs.front());
   const auto validate_family = [&](QFont& f) {
@@ -180,29 +207,33 @@ void QEditor::set_fonts(std::span<FontDesc> fontdescs)
     QFont f;
     set_fontdesc(f, fontdesc);
     validate_family(f);
-    set_relative_font_size(first_font, f, 0.0001, 1000);
+    set_relative_font_size(first_font, f, relative_tolerance, relative_iterations);
     f.setWeight(qfont_weight(default_font_weight()));
     f.setStyle(qfont_style(default_font_style()));
-    Font fo = f;
-    fonts.push_back(std::move(f));
+    font_list.push_back(std::move(f));
   }
   update_font_metrics();
+  // Zooming usually changes the size by a point at a time,
+  // so measure those sizes ahead of time.
+  FontMetricsCache::instance().prewarm_zoom_levels(
+    first_font, font_list, relative_tolerance, relative_iterations
+  );
 }
 
 void QEditor::update_font_metrics()
 {
   first_font.setLetterSpacing(QFont::AbsoluteSpacing, charspace);
-  QFontMetricsF metrics {first_font};
-  float combined_height = std::max(metrics.height(), metrics.lineSpacing());
+  const auto metrics = FontMetricsCache::instance().metrics(first_font);
+  double combined_height = std::max(metrics.height, metrics.line_spacing);
   double font_height = combined_height + linespacing();
-  constexpr QChar any_char = 'W';
-  double font_width = metrics.horizontalAdvance(any_char) + charspace;
-  for(auto& f : fonts)
+  double font_width = metrics.w_advance + charspace;
+  std::vector<QFont> spaced_fonts = font_list;
+  for(auto& f : spaced_fonts)
   {
-    QFont old_font = f.font();
-    old_font.setLetterSpacing(QFont::AbsoluteSpacing, charspace);
-    f = old_font;
+    f.setLetterSpacing(QFont::AbsoluteSpacing, charspace);
   }
+  // Editors with the same fonts share one set (and its caches)
+  shared = SharedFonts::acquire(std::move(spaced_fonts));
   set_font_dimensions(font_width, font_height);
   // This is safe because we created an instance of PopupMenuQ
   // in the popup_new() function
@@ -217,15 +248,42 @@ void QEditor::create_grid(u32 x, u32 y, u32 w, u32 h, u64 id)
   grids.push_back(std::make_unique<QPaintGrid>(this, x, y, w, h, id));
 }
 
-void QEditor::paintEvent(QPaintEvent*)
+void QEditor::paintEvent(QPaintEvent* event)
 {
   QPainter p(this);
+  // Cursor-only repaints don't present the grids, unless a frame is
+  // waiting to be presented.
+  if (cursor_only_pending && !frame_scheduled)
+  {
+    cursor_only_pending = false;
+    draw_region(p, event->rect());
+    return;
+  }
+  cursor_only_pending = false;
+  draw_frame(p);
+  // Only part of the widget was repainted (e.g. a partial expose),
+  // the rest of the frame still has to be shown.
+  if (frame_scheduled && event->rect() != rect()) update();
+  frame_scheduled = false;
+  frame_timer.stop();
+  since_last_frame.start();
+  ++frames_presented;
+  if (input_latency.painted(InputLatency::clock::now()) && pending_skipped > 0)
+  {
+    key_to_paint_loaded_ms.add(input_latency.samples(InputLatency::Total).last());
+  }
+  pending_skipped = 0;
+}
+
+void QEditor::draw_frame(QPainter& p)
+{
   p.fillRect(rect(), hl_state.default_colors_get().bg().value_or(0).qcolor());
   auto [cols, rows] = nvim_dimensions();
   auto [font_width, font_height] = font_dimensions();
   QRectF grid_clip_rect(0, 0, cols * font_width, rows * font_height);
   p.setClipRect(grid_clip_rect);
   p.setRenderHint(QPainter::SmoothPixmapTransform);
+  std::uint64_t state_changes = 0;
   for(auto& grid_base : grids)
   {
     auto* grid = static_cast<QPaintGrid*>(grid_base.get());
@@ -234,30 +292,145 @@ void QEditor::paintEvent(QPaintEvent*)
       QSize size = grid->buffer().size();
       auto r = QRectF(grid->pos(), size).intersected(grid_clip_rect);
       p.setClipRect(r);
+      const auto changes_before = grid->state_changes();
       grid->process_events();
+      state_changes += grid->state_changes() - changes_before;
       grid->render(p);
     }
   }
+  if (state_changes > 0) frame_state_changes = state_changes;
   p.setClipRect(rect());
-  if (!n_cursor.hidden() && cmdline->hidden())
+  draw_cursor(p);
+}
+
+void QEditor::draw_region(QPainter& p, const QRect& region)
+{
+  const bool animating = std::any_of(grids.begin(), grids.end(), [](auto& g) {
+    return !g->hidden && static_cast<QPaintGrid*>(g.get())->scrolling();
+  });
+  if (animating)
+  {
+    draw_frame(p);
+    return;
+  }
+  // Draw any updates that haven't been presented into the buffers
+  // first, or the cursor would be drawn over the old text.
+  for(auto& grid : grids)
+  {
+    if (!grid->hidden) static_cast<QPaintGrid*>(grid.get())->process_events();
+  }
+  p.fillRect(region, hl_state.default_colors_get().bg().value_or(0).qcolor());
+  auto [cols, rows] = nvim_dimensions();
+  auto [font_width, font_height] = font_dimensions();
+  const QRectF grid_clip_rect(0, 0, cols * font_width, rows * font_height);
+  const QRectF clip = grid_clip_rect.intersected(region);
+  for(const auto& grid_base : grids)
+  {
+    const auto* grid = static_cast<const QPaintGrid*>(grid_base.get());
+    if (grid->hidden) continue;
+    const QRectF area = QRectF(grid->pos(), grid->buffer().size());
+    const QRectF target = area.intersected(clip);
+    if (target.isEmpty()) continue;
+    p.drawImage(target, grid->buffer(), target.translated(-grid->pos()));
+  }
+  p.setClipRect(region);
+  draw_cursor(p);
+}
+
+void QEditor::draw_cursor(QPainter& p)
+{
+  drawn_cursor_rect = cursor_area();
+  if (!drawn_cursor_rect.isEmpty())
   {
     auto* grid = find_grid(n_cursor.grid_num());
-    if (grid) static_cast<QPaintGrid*>(grid)->draw_cursor(p, n_cursor);
+    static_cast<QPaintGrid*>(grid)->draw_cursor(p, n_cursor);
   }
 }
 
+QRect QEditor::cursor_area()
+{
+  if (n_cursor.hidden() || !cmdline->hidden()) return {};
+  auto* grid = find_grid(n_cursor.grid_num());
+  if (!grid) return {};
+  auto rect = static_cast<QPaintGrid*>(grid)->cursor_rect(n_cursor);
+  if (!rect) return {};
+  return rect->rect.toAlignedRect();
+}
+
+void QEditor::update_cursor_area()
+{
+  // The cmdline draws its own cursor
+  if (!cmdline->hidden()) cmdline->cursor_changed();
+  const QRect damage = drawn_cursor_rect.united(cursor_area());
+  if (damage.isEmpty()) return;
+  cursor_only_pending = true;
+  update(damage.adjusted(-1, -1, 1, 1));
+}
+
+std::map<std::string, double> QEditor::render_stats() const
+{
+  // Shared with the other editors using the same fonts
+  const auto& text_cache = shared->caches.text;
+  const auto& cache_stats = text_cache.stats();
+  std::map<std::string, double> stats {
+    {"painter_state_changes", double(frame_state_changes)},
+    {"text_cache_hits", double(cache_stats.hits)},
+    {"text_cache_misses", double(cache_stats.misses)},
+    {"text_cache_evictions", double(cache_stats.evictions)},
+    {"text_cache_bytes", double(text_cache.bytes())},
+    {"glyph_raster_cache_hits", double(shared->caches.rasters.stats().hits)},
+    {"glyph_raster_cache_misses", double(shared->caches.rasters.stats().misses)},
+    {"glyph_raster_cache_bytes", double(shared->caches.rasters.bytes())},
+    {"shared_font_sets", double(SharedFonts::live_count())},
+    {"shared_font_users", double(shared.use_count())},
+    {"cursor_wakeups", double(n_cursor.wakeup_count())},
+    {"cursor_wakeups_per_sec", double(n_cursor.wakeups_per_second())},
+    {"frames_presented", double(frames_presented)},
+    {"frames_skipped", double(frames_skipped)},
+    {"frame_interval_ms", double(frame_interval_ms())},
+    {"mouse_events", double(mouse_events)},
+    {"mouse_messages", double(mouse_messages)},
+    {"key_to_paint_ms_p50", input_latency.samples(InputLatency::Total).percentile(50)},
+    {"key_to_paint_ms_p99", input_latency.samples(InputLatency::Total).percentile(99)},
+    {"key_to_paint_under_load_ms_p50", key_to_paint_loaded_ms.percentile(50)},
+    {"key_to_paint_under_load_ms_p99", key_to_paint_loaded_ms.percentile(99)}
+  };
+  for(std::size_t i = 0; i < InputLatency::Total; ++i)
+  {
+    const auto stage = static_cast<InputLatency::Stage>(i);
+    const std::string name {InputLatency::stage_names[i]};
+    const auto& samples = input_latency.samples(stage);
+    stats["input_latency_" + name + "_ms_p50"] = samples.percentile(50);
+    stats["input_latency_" + name + "_ms_p99"] = samples.percentile(99);
+  }
+  stats["input_latency_folded_keys"] = double(input_latency.folded_keys());
+  stats["input_latency_dropped_keys"] = double(input_latency.dropped_keys());
+  if (const auto* popup = static_cast<const PopupMenuQ*>(popup_menu.get()))
+  {
+    const auto& popup_stats = popup->text_cache_stats();
+    stats["popup_text_cache_hits"] = double(popup_stats.hits);
+    stats["popup_text_cache_misses"] = double(popup_stats.misses);
+    stats["popup_text_cache_entries"] = double(popup->text_cache_entries());
+    stats["popup_text_cache_bytes"] = double(popup->text_cache_memory());
+    stats["popup_icon_cache_hits"] = double(popup->icon_cache_stats().hits);
+    stats["popup_icon_cache_misses"] = double(popup->icon_cache_stats().misses);
+  }
+  return stats;
+}
+
 u32 QEditor::font_for_ucs(u32 ucs)
 {
   if (ucs < 256) return 0;
-  auto it = fallback_indices.find(ucs);
-  if (it != fallback_indices.end()) return it->second;
+  auto& fallback_index = *shared->fallback_index;
+  if (auto idx = fallback_index.find(ucs)) return *idx;
   auto index = calc_fallback_index(ucs);
-  fallback_indices[ucs] = index;
+  fallback_index.set(ucs, index);
   return index;
 }
 
 u32 QEditor::calc_fallback_index(u32 ucs)
 {
+  const auto& fonts = shared->fonts;
   for(u32 i = 0; i < fonts.size(); ++i)
   {
     if (fonts[i].raw().supportsCharacter(ucs)) return i;
@@ -276,3 +449,12 @@ void QEditor::focusOutEvent(QFocusEvent* event)
   Base::handle_focuslost(event);
   QWidget::focusOutEvent(event);
 }
+
+void QEditor::hideEvent(QHideEvent* event)
+{
+  // The scheduled frame won't be painted
+  frame_scheduled = false;
+  cursor_only_pending = false;
+  frame_timer.stop();
+  QWidget::hideEvent(event);
+}
@@ -2,7 +2,12 @@
 #define NVUI_QEDITOR_HPP
 
 #include "qt_editorui_base.hpp"
+#include "shared_fonts.hpp"
+#include "stats.hpp"
+#include <QElapsedTimer>
+#include <QTimer>
 #include <QWidget>
+#include <optional>
 
 class Font;
 
@@ -21,14 +26,29 @@ public:
   );
   ~QEditor() override;
   void setup() override;
-  const auto& fallback_list() const { return fonts; }
+  const auto& fallback_list() const { return shared->fonts; }
+  /// The fonts and caches shared with other editors using the same fonts.
+  SharedFonts& shared_fonts() const { return *shared; }
   const auto& main_font() const { return first_font; }
   u32 font_for_ucs(u32 ucs);
+  /// Process every grid's events and composite the grids
+  /// (and the cursor) onto the painter.
+  /// This is what paintEvent() does, but it can be used to render
+  /// onto any paint device (e.g. a QImage for headless rendering).
+  void draw_frame(QPainter& p);
+  /// Redraw only the region from the grids' buffers (used for cursor
+  /// blinks and moves while no frame is scheduled).
+  void draw_region(QPainter& p, const QRect& region);
+  std::map<std::string, double> render_stats() const override;
 signals:
   void font_changed();
 protected:
   void linespace_changed(float new_ls) override;
   void charspace_changed(float new_cs) override;
+  void update_cursor_area() override;
+  /// Minimum time between two frames, based on the screen's
+  /// refresh rate.
+  int frame_interval_ms() const override;
 protected:
   void resizeEvent(QResizeEvent* event) override;
   void mousePressEvent(QMouseEvent* event) override;
@@ -42,6 +62,7 @@ protected:
   void keyPressEvent(QKeyEvent* event) override;
   void focusInEvent(QFocusEvent* event) override;
   void focusOutEvent(QFocusEvent* event) override;
+  void hideEvent(QHideEvent* event) override;
   bool focusNextPrevChild(bool) override { return false; }
 private:
   u32 calc_fallback_index(u32 ucs);
@@ -51,10 +72,32 @@ private:
   void create_grid(u32 x, u32 y, u32 w, u32 h, u64 id) override;
   void set_fonts(std::span<FontDesc> fonts) override;
 private:
-  std::unordered_map<u32, u32> fallback_indices;
+  /// QPainter state changes made by the last frame that drew anything.
+  std::uint64_t frame_state_changes = 0;
+  /// Where the cursor was drawn in the last frame (empty if it wasn't).
+  QRect drawn_cursor_rect;
+  QRect cursor_area();
+  void draw_cursor(QPainter& p);
+  /// Frame pacing. redraw() renders at most one frame per refresh
+  /// interval. Flushes that arrive while a frame is already scheduled
+  /// are folded into it and counted as skipped.
+  QTimer frame_timer;
+  QElapsedTimer since_last_frame;
+  bool frame_scheduled = false;
+  /// Set by update_cursor_area(), the next paint only needs to redraw
+  /// the cursor if no frame is scheduled.
+  bool cursor_only_pending = false;
+  std::uint64_t frames_presented = 0;
+  std::uint64_t frames_skipped = 0;
+  /// Flushes skipped since the last presented frame.
+  std::uint64_t pending_skipped = 0;
+  /// Key-to-paint latency for frames that had skipped flushes.
+  RollingSamples key_to_paint_loaded_ms;
   void update_font_metrics();
   QFont first_font;
-  std::vector<Font> fonts;
+  /// The fallback list from guifont, without the character spacing.
+  std::vector<QFont> font_list;
+  std::shared_ptr<SharedFonts> shared;
 };
 
 #endif // NVUI_QEDITOR_HPP
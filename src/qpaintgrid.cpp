@@ -1,7 +1,52 @@
 #include "qpaintgrid.hpp"
+#include "font_metrics_cache.hpp"
 #include "utils.hpp"
+#include <QFontDatabase>
+#include <QPen>
 #include <QPainterPath>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
 #include "qeditor.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+/// Minimum number of rows in a band for multi-threaded redraws.
+/// Below this the overhead of the extra images and the thread handoff
+/// outweighs the rasterization work.
+static constexpr int min_band_rows = 8;
+/// Number of horizontal subpixel positions text is rasterized at
+/// when the font dimensions are fractional.
+static constexpr int subpixel_buckets = 4;
+
+/// Rasterize prepared text onto an image width pixels wide filled with
+/// the run's background, shifted right by x_offset (a fraction of a pixel).
+/// The image is opaque so that the text keeps the subpixel antialiasing
+/// it gets when drawn directly onto the grid.
+static QImage rasterize_text(
+  const QStaticText& text,
+  const QFont& font,
+  const QColor& fg,
+  const QColor& bg,
+  double x_offset,
+  int width
+)
+{
+  QImage image(
+    std::max(1, width),
+    std::max(1, int(std::ceil(text.size().height()))),
+    QImage::Format_ARGB32_Premultiplied
+  );
+  image.fill(bg);
+  QPainter p(&image);
+  p.setRenderHint(QPainter::TextAntialiasing);
+  p.setFont(font);
+  p.setPen(fg);
+  p.drawStaticText(QPointF(x_offset, 0), text);
+  return image;
+}
 
 struct FontDecorationPaintPath
 {
@@ -63,24 +108,20 @@ static FontDecorationPaintPath calculate_path(
   return paint_path;
 }
 
-static void set_pen_width(QPainter& painter, double w)
-{
-  auto pen = painter.pen();
-  pen.setWidthF(w);
-  painter.setPen(pen);
-}
-
-void QPaintGrid::update_pixmap_size()
+void QPaintGrid::update_image_size()
 {
   auto&& [font_width, font_height] = editor_area->font_dimensions();
-  pixmap = QPixmap(cols * font_width, rows * font_height);
+  image = QImage(
+    cols * font_width, rows * font_height,
+    QImage::Format_ARGB32_Premultiplied
+  );
   send_redraw();
 }
 
 void QPaintGrid::set_size(u16 w, u16 h)
 {
   GridBase::set_size(w, h);
-  update_pixmap_size();
+  update_image_size();
   snapshots.clear(); // Outdated
 }
 
@@ -124,29 +165,76 @@ QFont::Style qfont_style(const FontOpts& fo)
   return QFont::StyleNormal;
 }
 
+/// Wraps a QPainter, skipping pen, font and clip changes that
+/// wouldn't change anything and counting the ones that do.
+struct QPaintGrid::PainterState
+{
+  PainterState(QPainter& painter, std::atomic<std::uint64_t>& counter)
+    : p(painter),
+      total(counter)
+  {
+  }
+  ~PainterState() { total += changes; }
+  void set_pen(const QColor& color, double width = 1.)
+  {
+    if (pen_color == color && pen_width == width) return;
+    pen_color = color;
+    pen_width = width;
+    QPen pen {color};
+    pen.setWidthF(width);
+    p.setPen(pen);
+    ++changes;
+  }
+  /// Fonts are compared by address. They come from the editor's
+  /// fallback list, which doesn't change while drawing.
+  void set_font(const QFont& f)
+  {
+    if (font == &f) return;
+    font = &f;
+    p.setFont(f);
+    ++changes;
+  }
+  void set_clip(const QRectF& r)
+  {
+    if (clip == r) return;
+    clip = r;
+    p.setClipRect(r);
+    ++changes;
+  }
+  QPainter& p;
+  std::optional<QColor> pen_color;
+  double pen_width = 1.;
+  const QFont* font = nullptr;
+  std::optional<QRectF> clip;
+  std::uint64_t changes = 0;
+  std::atomic<std::uint64_t>& total;
+};
+
 void QPaintGrid::draw_text(
-  QPainter& painter,
+  PainterState& st,
   const QString& text,
   const Color& fg,
+  const Color& bg,
   const std::optional<Color>& sp,
   const QRectF& rect,
   const FontOptions font_opts,
   const QFont& font,
   float font_width,
-  float font_height
+  float font_height,
+  GridCaches& caches
 )
 {
-  using key_type = decltype(text_cache)::key_type;
+  auto& cache = caches.text;
+  using key_type = TextCache::key_type;
   key_type key = {text, font_opts};
   auto w = font::weight_for(font_opts);
   auto s = font::style_for(font_opts);
   if (w == FontOpts::Normal) w = editor_area->default_font_weight();
   if (s == FontOpts::Normal) s = editor_area->default_font_style();
-  painter.setFont(font);
-  QStaticText* static_text = text_cache.get(key);
+  QStaticText* static_text = cache.get(key);
   if (!static_text)
   {
-    static_text = &text_cache.put(std::move(key), QStaticText {text});
+    static_text = &cache.put(std::move(key), QStaticText {text});
     static_text->setTextFormat(Qt::PlainText);
     static_text->setPerformanceHint(QStaticText::AggressiveCaching);
     static_text->prepare(QTransform(), font);
@@ -155,73 +243,97 @@ void QPaintGrid::draw_text(
   double y = rect.y();
   y -= (text_size.height() + editor_area->linespacing() - font_height);
   y += (editor_area->linespacing() / 2.);
-  painter.setClipRect(rect);
-  painter.setPen(fg.qcolor());
-  painter.drawStaticText(QPointF {rect.x(), y}, *static_text);
+  const bool fractional = font_width != std::floor(font_width)
+    || font_height != std::floor(font_height);
+  if (fractional)
+  {
+    // Snap to a quarter pixel, so each run is rasterized at most
+    // subpixel_buckets times and is drawn the same way every time.
+    double left = std::floor(rect.x());
+    auto bucket = int(std::lround((rect.x() - left) * subpixel_buckets));
+    if (bucket == subpixel_buckets)
+    {
+      left += 1.;
+      bucket = 0;
+    }
+    const double x_offset = double(bucket) / subpixel_buckets;
+    // Only the pixels the run's cells touch, the image is opaque and
+    // would paint over the neighbouring cells.
+    const auto width = int(std::ceil(x_offset + rect.width()));
+    GlyphRasterKey raster_key {
+      text, font_opts, &font, fg.to_uint32(), bg.to_uint32(),
+      std::uint16_t(width), std::uint8_t(bucket)
+    };
+    const QImage* raster = caches.rasters.get(raster_key);
+    if (!raster)
+    {
+      raster = &caches.rasters.put(std::move(raster_key), rasterize_text(
+        *static_text, font, fg.qcolor(), bg.qcolor(), x_offset, width
+      ));
+    }
+    st.p.drawImage(QPointF {left, std::round(y)}, *raster);
+  }
+  else
+  {
+    st.set_font(font);
+    st.set_pen(fg.qcolor());
+    st.p.drawStaticText(QPointF {rect.x(), y}, *static_text);
+  }
   QRectF line_clip_rect {
     rect.x(), rect.y(),
     static_text->size().width(), font_height
   };
   if (!sp) return;
-  painter.setPen(sp.value().qcolor());
   const auto draw_path = [&](const FontOpts fo) {
     auto [path, pen_w] = calculate_path(line_clip_rect, fo, font_width, font_height);
-    set_pen_width(painter, pen_w);
-    painter.drawPath(path);
+    st.set_pen(sp.value().qcolor(), pen_w);
+    st.p.drawPath(path);
   };
   if (font_opts & FontOpts::Underline) draw_path(FontOpts::Underline);
   if (font_opts & FontOpts::Undercurl) draw_path(FontOpts::Undercurl);
   if (font_opts & FontOpts::Strikethrough) draw_path(FontOpts::Strikethrough);
 }
 
-void QPaintGrid::draw_text_and_bg(
-  QPainter& painter,
-  const QString& text,
-  const HLAttr& attr,
-  const HLAttr& def_clrs,
-  const QPointF& start,
-  const QPointF& end,
-  const int offset,
-  const QFont& font,
-  float font_width,
-  float font_height
+void QPaintGrid::draw(
+  QPainter& p,
+  QRect r,
+  const double offset,
+  const std::vector<Font>& fonts,
+  GridCaches& caches,
+  std::span<const u32> cell_fonts
 )
 {
   Q_UNUSED(offset);
-  auto [fg, bg, sp] = attr.fg_bg_sp(def_clrs);
-  QRectF rect = {start, end};
-  painter.setClipRect(rect);
-  painter.fillRect(rect, bg.qcolor());
-  rect.setWidth(rect.width() * 3.);
-  draw_text(
-    painter, text, fg, sp, rect, attr.font_opts, font, font_width, font_height
-  );
-}
-
-void QPaintGrid::draw(QPainter& p, QRect r, const double offset)
-{
-  const auto& fonts = editor_area->fallback_list();
-  QFont cur_font = editor_area->main_font();
   auto font_dims = editor_area->font_dimensions();
   auto font_width = font_dims.width;
   auto font_height = font_dims.height;
-  //int start_x = r.left();
-  //int end_x = r.right();
   int start_y = r.top();
   int end_y = r.bottom();
   QString buffer;
   buffer.reserve(100);
   const HLState* s = &editor_area->hlstate();
-  const HLAttr& def_clrs = s->default_colors_get();
   u32 cur_font_idx = 0;
-  const auto draw_buf = [&](const HLAttr& main, QPointF start, QPointF end) {
+  PainterState st {p, painter_state_changes};
+  struct Run
+  {
+    QString text;
+    QRectF rect;
+    Color fg;
+    Color bg;
+    Color sp;
+    FontOptions font_opts;
+    const QFont* font;
+  };
+  /// Runs of the current row, from right to left.
+  std::vector<Run> runs;
+  std::vector<std::size_t> text_order;
+  const auto draw_buf = [&](const ResolvedAttr& main, QPointF start, QPointF end) {
     if (buffer.isEmpty()) return;
     reverse_qstring(buffer);
-    const auto& attr_font = fonts[cur_font_idx].font_for(main.font_opts);
-    draw_text_and_bg(
-      p, buffer, main, def_clrs, start, end,
-      offset, attr_font, font_width, font_height
-    );
+    runs.push_back({
+      buffer, {start, end}, main.fg, main.bg, main.sp, main.font_opts,
+      &fonts[cur_font_idx].font_for(main.font_opts)
+    });
     buffer.resize(0);
   };
   const auto get_pos = [&](int x, int y, int num_chars) {
@@ -229,19 +341,71 @@ void QPaintGrid::draw(QPainter& p, QRect r, const double offset)
     QPointF br((x + num_chars) * font_width, (y + 1) * font_height);
     return std::pair {tl, br};
   };
+  // Backgrounds are filled first, merging adjacent runs with the same
+  // background colour, then the text is drawn grouped by font and
+  // foreground colour so the painter's state changes as little as
+  // possible. Since every background of the row is down before any
+  // text, glyphs that overhang their cells are no longer painted over
+  // by the next run's background (except with fractional font
+  // dimensions, where text is drawn from opaque rasters).
+  const auto draw_row = [&](int y) {
+    st.set_clip({0, y * font_height, cols * font_width, font_height});
+    for(std::size_t i = 0; i < runs.size();)
+    {
+      QRectF bg_rect = runs[i].rect;
+      const Color& bg = runs[i].bg;
+      std::size_t j = i + 1;
+      for(; j < runs.size(); ++j)
+      {
+        if (!(runs[j].bg == bg) || runs[j].rect.right() != bg_rect.left()) break;
+        bg_rect.setLeft(runs[j].rect.left());
+      }
+      p.fillRect(bg_rect, bg.qcolor());
+      i = j;
+    }
+    text_order.resize(runs.size());
+    std::iota(text_order.begin(), text_order.end(), std::size_t(0));
+    std::sort(text_order.begin(), text_order.end(), [&](auto a, auto b) {
+      const auto& ra = runs[a];
+      const auto& rb = runs[b];
+      if (ra.font != rb.font) return std::less<>()(ra.font, rb.font);
+      return ra.fg.to_uint32() < rb.fg.to_uint32();
+    });
+    for(const auto i : text_order)
+    {
+      const auto& run = runs[i];
+      draw_text(
+        st, run.text, run.fg, run.bg, run.sp, run.rect, run.font_opts,
+        *run.font, font_width, font_height, caches
+      );
+    }
+    runs.clear();
+  };
+  // With ligatures enabled, runs are also split where whitespace
+  // starts or ends. Each word is then shaped on its own and starts at
+  // its own column, so a ligature or complex-script cluster whose
+  // shaped width doesn't match its cells can't push the rest of the
+  // line off the grid, and words repeated across lines hit the cache.
+  const bool shape_clusters = editor_area->ligatures_enabled();
   for(int y = start_y; y <= end_y && y < rows; ++y)
   {
     QPointF end = {cols * font_width, (y + 1) * font_height};
     int prev_hl_id = INT_MAX;
+    bool prev_space = false;
     /// Reverse iteration. This prevents text from clipping
     for(int x = cols - 1; x >= 0; --x)
     {
       const auto& gc = area[y * cols + x];
-      const auto font_idx = editor_area->font_for_ucs(gc.ucs);
+      const auto font_idx = cell_fonts.empty()
+        ? editor_area->font_for_ucs(gc.ucs)
+        : cell_fonts[std::size_t(y * cols + x)];
+      const bool space = gc.text.isEmpty() || gc.text[0].isSpace();
+      const bool cluster_break = shape_clusters && space != prev_space;
+      prev_space = space;
       if (gc.text.isEmpty())
       {
         const auto [tl, br] = get_pos(x + 1, y, 0);
-        draw_buf(s->attr_for_id(prev_hl_id), tl, end);
+        draw_buf(s->resolved(prev_hl_id), tl, end);
         end = br;
       }
       if (font_idx != cur_font_idx
@@ -249,7 +413,7 @@ void QPaintGrid::draw(QPainter& p, QRect r, const double offset)
       {
         const auto [tl, br] = get_pos(x, y, 1);
         QPointF buf_start = {br.x(), br.y() - font_height};
-        draw_buf(s->attr_for_id(prev_hl_id), buf_start, end);
+        draw_buf(s->resolved(prev_hl_id), buf_start, end);
         end = br;
         cur_font_idx = font_idx;
       }
@@ -258,11 +422,11 @@ void QPaintGrid::draw(QPainter& p, QRect r, const double offset)
         // Assume previous buffer already drawn.
         const auto [tl, br] = get_pos(x, y, 2);
         buffer.append(gc.text);
-        draw_buf(s->attr_for_id(gc.hl_id), tl, br);
+        draw_buf(s->resolved(gc.hl_id), tl, br);
         end = {tl.x(), tl.y() + font_height};
         prev_hl_id = gc.hl_id;
       }
-      else if (gc.hl_id == prev_hl_id)
+      else if (gc.hl_id == prev_hl_id && !cluster_break)
       {
         buffer.append(gc.text);
         continue;
@@ -271,40 +435,109 @@ void QPaintGrid::draw(QPainter& p, QRect r, const double offset)
       {
         const auto [tl, br] = get_pos(x, y, 1);
         QPointF start = {br.x(), br.y() - font_height};
-        draw_buf(s->attr_for_id(prev_hl_id), start, end);
+        draw_buf(s->resolved(prev_hl_id), start, end);
         end = br;
         buffer.append(gc.text);
         prev_hl_id = gc.hl_id;
       }
     }
     QPointF start = {0, y * font_height};
-    draw_buf(s->attr_for_id(prev_hl_id), start, end);
+    draw_buf(s->resolved(prev_hl_id), start, end);
+    draw_row(y);
+  }
+}
+
+void QPaintGrid::draw_all(QPainter& p, const double offset)
+{
+  const int max_bands = std::min(QThread::idealThreadCount(), rows / min_band_rows);
+  if (max_bands <= 1 || !QFontDatabase::supportsThreadedFontRendering())
+  {
+    auto& shared = editor_area->shared_fonts();
+    draw(p, {0, 0, cols, rows}, offset, shared.fonts, shared.caches);
+    return;
   }
+  // font_for_ucs() fills the editor's fallback cache on a miss, so
+  // the fonts are looked up here and the bands only read the result.
+  std::vector<u32> cell_fonts(area.size());
+  for(std::size_t i = 0; i < area.size(); ++i)
+  {
+    cell_fonts[i] = editor_area->font_for_ucs(area[i].ucs);
+  }
+  // QFont is only reentrant, so each band draws with its own copies
+  // of the fonts (see SharedFonts::band_fonts).
+  auto& shared = editor_area->shared_fonts();
+  shared.reserve_band_caches(std::size_t(max_bands));
+  const auto& band_fonts = shared.band_fonts;
+  auto& band_caches = shared.band_caches;
+  auto [font_width, font_height] = editor_area->font_dimensions();
+  const int band_rows = (rows + max_bands - 1) / max_bands;
+  const int num_bands = (rows + band_rows - 1) / band_rows;
+  const QColor bg = editor_area->hlstate().default_bg().qcolor();
+  std::vector<QImage> bands(num_bands);
+  // Bands are split on row boundaries and draw() clips every run to its
+  // row, so nothing is drawn across a band edge. Double-width and
+  // overhanging glyphs only interact with cells in the same row, which
+  // draw() still visits right-to-left within a single band.
+  const auto draw_band = [&, font_height = font_height](int band) {
+    const int top = band * band_rows;
+    const int height = std::min(band_rows, rows - top);
+    QImage& img = bands[band];
+    img = QImage(image.width(), int(height * font_height), image.format());
+    img.fill(bg);
+    QPainter bp(&img);
+    bp.setRenderHint(QPainter::TextAntialiasing);
+    bp.translate(0, -top * font_height);
+    draw(
+      bp, {0, top, cols, height}, offset, band_fonts[band],
+      *band_caches[band], cell_fonts
+    );
+  };
+  QSemaphore done;
+  auto* pool = QThreadPool::globalInstance();
+  for(int band = 1; band < num_bands; ++band)
+  {
+    pool->start(QRunnable::create([&, band] {
+      draw_band(band);
+      done.release();
+    }));
+  }
+  draw_band(0);
+  done.acquire(num_bands - 1);
+  const auto mode = p.compositionMode();
+  p.setCompositionMode(QPainter::CompositionMode_Source);
+  for(int band = 0; band < num_bands; ++band)
+  {
+    p.drawImage(QPointF(0, band * band_rows * font_height), bands[band]);
+  }
+  p.setCompositionMode(mode);
 }
 
 void QPaintGrid::process_events()
 {
   if (evt_q.empty()) return;
-  QPainter p(&pixmap);
+  QPainter p(&image);
   p.setRenderHint(QPainter::TextAntialiasing);
   const QColor bg = editor_area->hlstate().default_bg().qcolor();
-  QFontMetrics fm {editor_area->main_font()};
-  const auto offset = fm.ascent() + (editor_area->linespacing() / 2.f);
+  const auto fm = FontMetricsCache::instance().metrics(editor_area->main_font());
+  const auto offset = fm.ascent + (editor_area->linespacing() / 2.f);
   while(!evt_q.empty())
   {
     const auto& evt = evt_q.front();
     switch(evt.type)
     {
       case PaintKind::Clear:
-        p.fillRect(pixmap.rect(), bg);
+        p.fillRect(image.rect(), bg);
         break;
       case PaintKind::Redraw:
-        draw(p, {0, 0, cols, rows}, offset);
+        draw_all(p, offset);
         clear_event_queue();
         return;
       case PaintKind::Draw:
-        draw(p, evt.draw_info().rect, offset);
+      {
+        auto& shared = editor_area->shared_fonts();
+        draw(p, evt.draw_info().rect, offset, shared.fonts, shared.caches);
         break;
+      }
       case PaintKind::Scroll:
       {
         auto [font_width, font_height] = editor_area->font_dimensions();
@@ -315,13 +548,11 @@ void QPaintGrid::process_events()
           rect.width() * font_width,
           rect.height() * font_height
         );
-        // This would probably be faster using QPixmap::scroll
-        // but it doesn't want to work
         p.end();
-        QPixmap px = pixmap.copy(r);
+        QImage px = image.copy(r);
         QPoint tl((rect.x() + dx) * font_width, (rect.y() + dy) * font_height);
-        p.begin(&pixmap);
-        p.drawPixmap(tl, px, px.rect());
+        p.begin(&image);
+        p.drawImage(tl, px, px.rect());
         break;
       }
     }
@@ -332,11 +563,11 @@ void QPaintGrid::process_events()
 void QPaintGrid::render(QPainter& p)
 {
   auto&& [font_width, font_height] = editor_area->font_dimensions();
-  QRectF rect(top_left.x(), top_left.y(), pixmap.width(), pixmap.height());
-  auto snapshot_height = pixmap.height();
+  QRectF rect(top_left.x(), top_left.y(), image.width(), image.height());
+  auto snapshot_height = image.height();
   if (!editor_area->animations_enabled() || !is_scrolling)
   {
-    p.drawPixmap(pos(), pixmap);
+    p.drawImage(pos(), image);
     return;
   }
   p.fillRect(rect, editor_area->hlstate().default_bg().qcolor());
@@ -350,33 +581,33 @@ void QPaintGrid::render(QPainter& p)
     QRectF r;
     float snapshot_top = snapshot.vp.topline * font_height;
     float offset = snapshot_top - cur_scroll_y;
-    auto pixmap_top = top_left.y() + offset;
+    auto image_top = top_left.y() + offset;
     QPointF pt;
     if (snapshot.vp.topline < min_topline)
     {
       auto height = (min_topline - snapshot.vp.topline) * font_height;
       height = std::min(height, float(snapshot_height));
       min_topline = snapshot.vp.topline;
-      r = QRect(0, 0, pixmap.width(), height);
-      pt = {top_left.x(), pixmap_top};
+      r = QRect(0, 0, image.width(), height);
+      pt = {top_left.x(), image_top};
     }
     else if (snapshot.vp.botline > max_botline)
     {
       auto height = (snapshot.vp.botline - max_botline) * font_height;
       height = std::min(height, float(snapshot_height));
       max_botline = snapshot.vp.botline;
-      r = QRect(0, snapshot_height - height, pixmap.width(), height);
-      pt = {top_left.x(), pixmap_top + pixmap.height() - height};
+      r = QRect(0, snapshot_height - height, image.width(), height);
+      pt = {top_left.x(), image_top + image.height() - height};
     }
     QRectF draw_rect = {top_left, r.size()};
     if (!r.isNull() && rect.contains(draw_rect))
     {
-      p.drawPixmap(pt, snapshot.image, r);
+      p.drawImage(pt, snapshot.image, r);
     }
   }
   float offset = cur_snapshot_top - cur_scroll_y;
   QPointF pt = {top_left.x(), top_left.y() + offset};
-  p.drawPixmap(pt, pixmap);
+  p.drawImage(pt, image);
 }
 
 void QPaintGrid::viewport_changed(Viewport vp)
@@ -394,7 +625,7 @@ void QPaintGrid::viewport_changed(Viewport vp)
   auto dest_topline = vp.topline;
   start_scroll_y = current_scroll_y;
   destination_scroll_y = static_cast<float>(dest_topline);
-  snapshots.push_back({viewport, pixmap});
+  snapshots.push_back({viewport, image});
   if (snapshots.size() > editor_area->snapshot_limit())
   {
     snapshots.erase(snapshots.begin());
@@ -419,8 +650,11 @@ void QPaintGrid::update_position(double new_x, double new_y)
 
 void QPaintGrid::initialize_cache()
 {
+  // The text caches belong to the editor's SharedFonts, which are
+  // replaced when the fonts change, so only the cursor layer needs
+  // to be thrown away here.
   QObject::connect(editor_area, &QEditor::font_changed, this, [&] {
-    text_cache.clear();
+    cursor_layer.image = QImage();
   });
 }
 
@@ -474,43 +708,87 @@ void QPaintGrid::initialize_move_animation()
   });
 }
 
-void QPaintGrid::draw_cursor(QPainter& painter, const Cursor& cursor)
+std::optional<CursorRect> QPaintGrid::cursor_rect(const Cursor& cursor) const
 {
   const auto [font_width, font_height] = editor_area->font_dimensions();
-  const HLState* hl = &editor_area->hlstate();
   auto pos_opt = cursor.pos();
-  if (!pos_opt) return;
+  if (!pos_opt) return std::nullopt;
   auto pos = pos_opt.value();
   std::size_t idx = pos.row * cols + pos.col;
-  if (idx >= area.size()) return;
-  const auto& gc = area[idx];
-  float scale_factor = 1.0f;
-  if (gc.double_width) scale_factor = 2.0f;
-  auto rect_opt = cursor.rect(font_width, font_height, scale_factor, true);
+  if (idx >= area.size()) return std::nullopt;
+  float scale_factor = area[idx].double_width ? 2.0f : 1.0f;
+  return cursor.rect(font_width, font_height, scale_factor, true);
+}
+
+void QPaintGrid::draw_cursor(QPainter& painter, const Cursor& cursor)
+{
+  const auto [font_width, font_height] = editor_area->font_dimensions();
+  const HLState* hl = &editor_area->hlstate();
+  auto rect_opt = cursor_rect(cursor);
   if (!rect_opt) return;
   auto [rect, hl_id, should_draw_text, opacity] = rect_opt.value();
+  auto pos = cursor.pos().value();
+  const auto& gc = area[pos.row * cols + pos.col];
+  float scale_factor = gc.double_width ? 2.0f : 1.0f;
   const HLAttr& cursor_attr = hl->attr_for_id(hl_id);
   Color fg = cursor_attr.fg().value_or(hl->default_fg());
   Color bg = cursor_attr.bg().value_or(hl->default_bg());
   if (hl_id == 0 || cursor_attr.reverse) std::swap(fg, bg);
   painter.setOpacity(opacity);
-  painter.fillRect(rect, bg.qcolor());
-  painter.setOpacity(1.0);
-  if (should_draw_text)
+  if (!should_draw_text)
   {
-    float left = (x + pos.col) * font_width;
-    float top = (y + pos.row) * font_height;
-    const QPointF bot_left {left, top};
-    auto font_idx = editor_area->font_for_ucs(gc.ucs);
-    FontOptions opts = cursor_attr.font_opts == FontOpts::Normal
-      ? hl->attr_for_id(gc.hl_id).font_opts
-      : cursor_attr.font_opts;
-    QFont chosen_font = editor_area->fallback_list()[font_idx].font();
-    QRectF text_rect(left, top, font_width * scale_factor * 5., font_height);
-    draw_text(
-      painter, gc.text, fg, cursor_attr.sp(), text_rect,
-      opts, chosen_font, font_width, font_height
+    painter.fillRect(rect, bg.qcolor());
+    painter.setOpacity(1.0);
+    return;
+  }
+  // The cell the text is in. Animations and effects move or shrink
+  // the cursor over it, which only changes the part that is blitted.
+  const QRectF cell {
+    (x + pos.col) * font_width, (y + pos.row) * font_height,
+    font_width * scale_factor, font_height
+  };
+  CursorLayer key;
+  key.size = {int(std::ceil(cell.width())), int(std::ceil(cell.height()))};
+  key.fg = fg;
+  key.bg = bg;
+  key.text = gc.text;
+  key.font_idx = editor_area->font_for_ucs(gc.ucs);
+  key.font_opts = cursor_attr.font_opts == FontOpts::Normal
+    ? hl->attr_for_id(gc.hl_id).font_opts
+    : cursor_attr.font_opts;
+  key.sp = cursor_attr.sp();
+  if (cursor_layer.image.isNull() || !cursor_layer.same_as(key))
+  {
+    key.image = QImage(key.size, QImage::Format_ARGB32_Premultiplied);
+    key.image.fill(bg.qcolor());
+    {
+      QPainter lp(&key.image);
+      lp.setRenderHint(QPainter::TextAntialiasing);
+      PainterState st {lp, painter_state_changes};
+      const QFont& chosen_font = editor_area->fallback_list()[key.font_idx].font();
+      draw_text(
+        st, key.text, fg, bg, key.sp, {QPointF {0, 0}, cell.size()},
+        key.font_opts, chosen_font, font_width, font_height,
+        editor_area->shared_fonts().caches
+      );
+    }
+    cursor_layer = std::move(key);
+  }
+  const QRectF visible = rect & cell;
+  if (visible != rect)
+  {
+    // The parts of the cursor that are outside of the cell
+    QPainterPath outside;
+    outside.addRect(rect);
+    QPainterPath inside;
+    inside.addRect(visible);
+    painter.fillPath(outside.subtracted(inside), bg.qcolor());
+  }
+  if (!visible.isEmpty())
+  {
+    painter.drawImage(
+      visible, cursor_layer.image, visible.translated(-cell.topLeft())
     );
   }
+  painter.setOpacity(1.0);
 }
-
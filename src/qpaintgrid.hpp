@@ -1,21 +1,30 @@
 #ifndef NVUI_QPAINTGRID_HPP
 #define NVUI_QPAINTGRID_HPP
 
+#include <QImage>
 #include <QStaticText>
 #include <QString>
 #include <QTimer>
 #include <QWidget>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
 #include "cursor.hpp"
 #include "grid.hpp"
 #include "hlstate.hpp"
-#include "lru.hpp"
+#include "shared_fonts.hpp"
+#include "utils.hpp"
 
 class QEditor;
 
 /// A class that implements rendering for a grid using Qt's
-/// QPainter. The QPaintGrid class draws to a QPixmap and
-/// works with the EditorArea class to draw these pixmaps to
+/// QPainter. The QPaintGrid class draws to a QImage and
+/// works with the EditorArea class to draw these images to
 /// the screen.
+/// QImage is used instead of QPixmap since it is rasterized in software
+/// on every platform, so grids can be rendered without a display
+/// (e.g. under QT_QPA_PLATFORM=offscreen).
 class QPaintGrid : public GridBase
 {
   Q_OBJECT
@@ -23,18 +32,38 @@ class QPaintGrid : public GridBase
   struct Snapshot
   {
     Viewport vp;
-    QPixmap image;
+    QImage image;
+  };
+  /// The cell under a block cursor prerendered with the cursor's
+  /// colours. Only redrawn when the cell's text, font or the colours
+  /// change, blink and animation frames blit the part of it the
+  /// cursor covers.
+  struct CursorLayer
+  {
+    QSize size;
+    Color fg;
+    Color bg;
+    std::optional<Color> sp;
+    QString text;
+    u32 font_idx = 0;
+    FontOptions font_opts = FontOpts::Normal;
+    QImage image;
+    bool same_as(const CursorLayer& o) const
+    {
+      return size == o.size && fg == o.fg && bg == o.bg && sp == o.sp
+        && text == o.text && font_idx == o.font_idx
+        && font_opts == o.font_opts;
+    }
   };
 public:
   template<typename... GridBaseArgs>
   QPaintGrid(QEditor* ea, GridBaseArgs... args)
     : GridBase(args...),
       editor_area(ea),
-      pixmap(),
-      top_left(),
-      text_cache(2000)
+      image(),
+      top_left()
   {
-    update_pixmap_size();
+    update_image_size();
     update_position(x, y);
     initialize_cache();
     initialize_scroll_animation();
@@ -46,45 +75,64 @@ public:
   void viewport_changed(Viewport vp) override;
   /// Process the draw commands in the event queue
   void process_events();
-  /// Returns the grid's paint buffer (QPixmap)
-  const QPixmap& buffer() const { return pixmap; }
+  /// Returns the grid's paint buffer (QImage)
+  const QImage& buffer() const { return image; }
   /// The top-left corner of the grid (where to start drawing the buffer).
   QPointF pos() const { return top_left; }
+  /// Number of QPainter state changes (pen, font and clip) made
+  /// while drawing this grid so far.
+  std::uint64_t state_changes() const { return painter_state_changes; }
   /// Renders to the painter.
   void render(QPainter& painter);
+  /// Whether render() draws scroll animation snapshots instead of
+  /// the buffer.
+  bool scrolling() const { return is_scrolling; }
   /// Draws the cursor on the painter, relative to the grid's
   /// current position (see pos())
   void draw_cursor(QPainter& painter, const Cursor& cursor);
+  /// The area the cursor covers on this grid (in pixels),
+  /// or nullopt if the cursor isn't on this grid.
+  std::optional<CursorRect> cursor_rect(const Cursor& cursor) const;
 private:
-  /// Draw the grid range given by the rect.
-  void draw(QPainter& p, QRect r, const double font_offset);
-  /// Draw the given text with attr and def_clrs indicating
-  /// the background, foreground colors and font options.
-  void draw_text_and_bg(
-    QPainter& painter,
-    const QString& text,
-    const HLAttr& attr,
-    const HLAttr& def_clrs,
-    const QPointF& start,
-    const QPointF& end,
-    const int offset,
-    const QFont& font,
-    float font_width,
-    float font_height
+  /// Draw the grid range given by the rect, using the given
+  /// fallback fonts and caches.
+  /// cell_fonts, if given, is the index of the fallback font for each
+  /// cell of the grid. Otherwise they're looked up through the editor,
+  /// which is only safe on the GUI thread.
+  void draw(
+    QPainter& p,
+    QRect r,
+    const double font_offset,
+    const std::vector<Font>& fonts,
+    GridCaches& caches,
+    std::span<const u32> cell_fonts = {}
   );
+  /// Redraw the entire grid.
+  /// For large grids the rows are split into horizontal bands that
+  /// are rasterized into separate images on the global thread pool,
+  /// then composited onto the grid's image.
+  void draw_all(QPainter& p, const double font_offset);
+  struct PainterState;
+  /// Draw the text at rect. The caller is responsible for clipping.
+  /// When the font dimensions are fractional, the text is drawn from
+  /// a raster cached per subpixel offset (see GlyphRasterKey) so
+  /// that it lands on the same pixels everywhere. The raster is filled
+  /// with bg and clipped to rect, so glyphs overhanging the run are cut.
   void draw_text(
-    QPainter& painter,
+    PainterState& st,
     const QString& text,
     const Color& fg,
+    const Color& bg,
     const std::optional<Color>& sp,
     const QRectF& rect,
     const FontOptions font_opts,
     const QFont& font,
     float font_width,
-    float font_height
+    float font_height,
+    GridCaches& caches
   );
-  /// Update the pixmap size
-  void update_pixmap_size();
+  /// Update the image size
+  void update_image_size();
   /// Initialize the cache
   void initialize_cache();
   /// Initialize scroll animation timer
@@ -97,7 +145,7 @@ private:
   std::vector<Snapshot> snapshots;
   /// Links up with the default Qt rendering
   QEditor* editor_area;
-  QPixmap pixmap;
+  QImage image;
   QTimer move_update_timer {};
   float move_animation_time = -1.f;
   QPointF top_left;
@@ -113,8 +161,8 @@ private:
   float old_move_x = 0.f;
   float old_move_y = 0.f;
   float destination_scroll_y = 0.f;
-  using FontOptions = decltype(HLAttr::font_opts);
-  LRUCache<QPair<QString, FontOptions>, QStaticText> text_cache;
+  std::atomic<std::uint64_t> painter_state_changes = 0;
+  CursorLayer cursor_layer;
 };
 
 QFont::Weight qfont_weight(const FontOpts& fo);
@@ -4,7 +4,9 @@
 #include "scalers.hpp"
 #include <QApplication>
 #include <QDir>
+#include <QFile>
 #include <QMimeData>
+#include <cstdlib>
 #include <fmt/format.h>
 
 QtEditorUIBase::QtEditorUIBase(
@@ -25,6 +27,11 @@ QtEditorUIBase::QtEditorUIBase(
   idle_timer.callOnTimeout([&] { idle(); });
   idle_timer.start();
   idle_timer.setTimerType(Qt::VeryCoarseTimer);
+  mouse_timer.setSingleShot(true);
+  mouse_timer.callOnTimeout([this] {
+    // Keep sending at most once per interval while input keeps coming
+    if (flush_mouse_input()) mouse_timer.start(frame_interval_ms());
+  });
 }
 
 void QtEditorUIBase::setup()
@@ -32,13 +39,13 @@ void QtEditorUIBase::setup()
   Base::setup();
   register_command_handlers();
   QObject::connect(&n_cursor, &Cursor::anim_state_changed, &inheritor, [this] {
-    inheritor.update();
+    update_cursor_area();
   });
   QObject::connect(&n_cursor, &Cursor::cursor_hidden, &inheritor, [this] {
-    inheritor.update();
+    update_cursor_area();
   });
   QObject::connect(&n_cursor, &Cursor::cursor_visible, &inheritor, [this] {
-    inheritor.update();
+    update_cursor_area();
   });
 }
 
@@ -104,12 +111,36 @@ static QRectF scaled(const QRectF& r, float hor, float vert)
 
 void QtEditorUIBase::handle_key_press(QKeyEvent* event)
 {
+  const auto pressed = InputLatency::clock::now();
   un_idle();
   typed();
   event->accept();
   auto text = convert_key(*event);
   if (text.empty()) return;
+  input_latency.key_pressed(pressed);
+  // The input is written synchronously
   nvim->send_input(std::move(text));
+  input_latency.input_written(InputLatency::clock::now());
+  if (popup_menu->fuzzy_enabled() && !popup_menu->hidden())
+  {
+    filter_popup_menu(*event);
+  }
+}
+
+void QtEditorUIBase::filter_popup_menu(const QKeyEvent& event)
+{
+  const auto mods = Qt::ControlModifier | Qt::AltModifier | Qt::MetaModifier;
+  if (event.modifiers() & mods) return;
+  if (event.key() == Qt::Key_Backspace)
+  {
+    popup_menu->filter_backspace();
+    return;
+  }
+  const QString text = event.text();
+  if (text.size() == 1 && (text.at(0).isLetterOrNumber() || text.at(0) == '_'))
+  {
+    popup_menu->filter_typed(text.toStdString());
+  }
 }
 
 QVariant QtEditorUIBase::handle_ime_query(Qt::InputMethodQuery query)
@@ -179,6 +210,14 @@ QtEditorUIBase::grid_pos_for(QPoint pos) const
   return std::nullopt;
 }
 
+std::optional<QtEditorUIBase::GridPos>
+QtEditorUIBase::mouse_grid_pos(QPoint pos) const
+{
+  auto grid_pos = grid_pos_for(pos);
+  if (grid_pos && !ext.multigrid) grid_pos->grid_num = 0;
+  return grid_pos;
+}
+
 void QtEditorUIBase::send_mouse_input(
   QPoint pos,
   std::string btn,
@@ -187,24 +226,58 @@ void QtEditorUIBase::send_mouse_input(
 )
 {
   if (!mouse_enabled()) return;
-  auto grid_pos_opt = grid_pos_for(pos);
+  auto grid_pos_opt = mouse_grid_pos(pos);
   if (!grid_pos_opt)
   {
     return;
   }
-  auto&& [grid_num, row, col] = *grid_pos_opt;
-  if (!ext.multigrid) grid_num = 0;
-  if (action == "drag" && mouse.gridid == grid_num && mouse.row == row && mouse.col == col)
-  {
-    return;
-  }
+  // Keep the order of events
+  flush_mouse_input();
+  send_mouse({std::move(btn), std::move(action), std::move(mods), *grid_pos_opt});
+}
+
+void QtEditorUIBase::send_mouse(const MouseInput& input)
+{
+  auto&& [grid_num, row, col] = input.pos;
   mouse.gridid = grid_num;
   mouse.row = row;
   mouse.col = col;
   nvim->input_mouse(
-    std::move(btn), std::move(action), std::move(mods),
-    grid_num, row, col
+    input.button, input.action, input.mods,
+    grid_num, row, col, input.count
   );
+  ++mouse_messages;
+}
+
+void QtEditorUIBase::throttle_mouse_input()
+{
+  // Sent when the interval ends
+  if (mouse_timer.isActive()) return;
+  flush_mouse_input();
+  mouse_timer.start(frame_interval_ms());
+}
+
+bool QtEditorUIBase::flush_mouse_input()
+{
+  bool sent = false;
+  if (pending_drag)
+  {
+    const auto& pos = pending_drag->pos;
+    // The drag may have ended up back where it was last sent
+    if (mouse.gridid != pos.grid_num || mouse.row != pos.row || mouse.col != pos.col)
+    {
+      send_mouse(*pending_drag);
+      sent = true;
+    }
+    pending_drag.reset();
+  }
+  if (pending_wheel)
+  {
+    send_mouse(*pending_wheel);
+    pending_wheel.reset();
+    sent = true;
+  }
+  return sent;
 }
 
 void QtEditorUIBase::handle_mouse_press(QMouseEvent* event)
@@ -227,16 +300,37 @@ void QtEditorUIBase::handle_wheel(QWheelEvent* event)
   un_idle();
   unhide_cursor();
   if (!mouse_enabled()) return;
-  std::string button = "wheel";
-  std::string action = "";
+  const int delta = event->angleDelta().y();
+  if (delta == 0) return;
+  ++mouse_events;
+  int steps = 1;
+  if (wheel_step > 0)
+  {
+    // Scrolling the other way drops what was accumulated
+    if ((wheel_delta < 0) != (delta < 0)) wheel_delta = 0;
+    wheel_delta += delta;
+    steps = std::abs(wheel_delta) / wheel_step;
+    wheel_delta %= wheel_step;
+    if (steps == 0) return;
+  }
+  std::string action = delta > 0 ? "up" : "down";
   auto mods = mouse_mods_to_string(event->modifiers());
-  if (event->angleDelta().y() > 0) /* scroll up */ action = "up";
-  else if (event->angleDelta().y() < 0) /* scroll down */ action = "down";
-  if (action.empty()) return;
-  QPoint wheel_pos = event->position().toPoint();
-  send_mouse_input(
-    wheel_pos, std::move(button), std::move(action), std::move(mods)
-  );
+  auto grid_pos = mouse_grid_pos(event->position().toPoint());
+  if (!grid_pos) return;
+  if (pending_wheel)
+  {
+    const auto& p = pending_wheel->pos;
+    const bool same_target = p.grid_num == grid_pos->grid_num
+      && p.row == grid_pos->row && p.col == grid_pos->col;
+    if (same_target && pending_wheel->action == action && pending_wheel->mods == mods)
+    {
+      pending_wheel->count += steps;
+      return;
+    }
+    flush_mouse_input();
+  }
+  pending_wheel = MouseInput {"wheel", std::move(action), std::move(mods), *grid_pos, steps};
+  throttle_mouse_input();
 }
 
 void QtEditorUIBase::handle_mouse_move(QMouseEvent* event)
@@ -246,13 +340,15 @@ void QtEditorUIBase::handle_mouse_move(QMouseEvent* event)
   if (!mouse_enabled()) return;
   auto button = mouse_button_to_string(event->buttons());
   if (button.empty()) return;
+  ++mouse_events;
+  auto grid_pos = mouse_grid_pos(event->pos());
+  if (!grid_pos) return;
+  auto&& [grid_num, row, col] = *grid_pos;
+  const bool sent_here = mouse.gridid == grid_num && mouse.row == row && mouse.col == col;
+  if (!pending_drag && sent_here) return;
   auto mods = mouse_mods_to_string(event->modifiers());
-  std::string action = "drag";
-  const auto [f_width, f_height] = font_dimensions();
-  QPoint text_pos(event->x() / f_width, event->y() / f_height);
-  send_mouse_input(
-    event->pos(), std::move(button), std::move(action), std::move(mods)
-  );
+  pending_drag = MouseInput {std::move(button), "drag", std::move(mods), *grid_pos};
+  throttle_mouse_input();
 }
 
 void QtEditorUIBase::handle_mouse_release(QMouseEvent* event)
@@ -316,6 +412,14 @@ void QtEditorUIBase::set_animations_enabled(bool enabled)
   n_cursor.set_animations_enabled(enabled);
 }
 
+void QtEditorUIBase::set_ligatures_enabled(bool enabled)
+{
+  if (ligatures == enabled) return;
+  ligatures = enabled;
+  send_redraw();
+  inheritor.update();
+}
+
 float QtEditorUIBase::charspacing() const
 {
   return charspace;
@@ -386,6 +490,9 @@ void QtEditorUIBase::register_command_handlers()
   on("NVUI_TOGGLE_FRAMELESS", [this](const auto&) {
     emit signaller.titlebar_toggled();
   });
+  on("NVUI_LIGATURES", paramify<bool>([this](bool enabled) {
+    set_ligatures_enabled(enabled);
+  }));
   on("NVUI_CHARSPACE", paramify<float>([this](float space) {
     charspace = space;
     charspace_changed(charspace);
@@ -541,6 +648,10 @@ void QtEditorUIBase::register_command_handlers()
     paramify<bool>([this](bool b) {
       nvim->ui_set_option("ext_cmdline", b);
   }));
+  on("NVUI_MOUSE_WHEEL_STEP", paramify<int>([this](int delta) {
+    wheel_step = std::max(delta, 0);
+    wheel_delta = 0;
+  }));
   on("NVUI_IDLE_WAIT_FOR",
     paramify<double>([this](double seconds) {
       idle_timer.setInterval(seconds * 1000);
@@ -575,6 +686,33 @@ void QtEditorUIBase::register_command_handlers()
     [&](const auto&) {
       return tuple {scalers::scaler_names(), std::nullopt};
   }, &inheritor);
+  handle_request<map<string, double>, int>(*nvim, "NVUI_RENDER_STATS",
+    [&](const auto&) {
+      return tuple {render_stats(), std::nullopt};
+  }, &inheritor);
+  handle_request<map<string, vector<double>>, int>(*nvim, "NVUI_INPUT_LATENCY",
+    [&](const auto&) {
+      map<string, vector<double>> histograms;
+      const auto& bounds = InputLatency::bucket_bounds;
+      histograms["bounds_ms"] = vector<double>(bounds.begin(), bounds.end());
+      for(size_t i = 0; i < InputLatency::StageCount; ++i)
+      {
+        const auto stage = static_cast<InputLatency::Stage>(i);
+        const auto counts = input_latency.samples(stage).histogram(bounds);
+        histograms[string(InputLatency::stage_names[i])] =
+          vector<double>(counts.begin(), counts.end());
+      }
+      return tuple {histograms, std::nullopt};
+  }, &inheritor);
+  on("NVUI_INPUT_LATENCY_DUMP", paramify<std::string>([this](std::string path) {
+    QFile file {QString::fromStdString(path)};
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+      nvim->err_write(fmt::format("Could not write to '{}'.\n", path));
+      return;
+    }
+    file.write(QByteArray::fromStdString(input_latency.csv()));
+  }));
   nvim->set_var("nvui_tb_separator", " • ");
   nvim->exec_viml(R"(
   function! NvuiGetChan()
@@ -615,6 +753,7 @@ void QtEditorUIBase::register_command_handlers()
   command! -nargs=1 -complete=customlist,NvuiComplete_cursoreff NvuiCursorEffect call NvuiNotify('NVUI_CURSOR_EFFECT', <f-args>)
   command! -nargs=1 NvuiCursorEffectFrametime call rpcnotify(g:nvui_rpc_chan, 'NVUI_CURSOR_EFFECT_FRAMETIME', <args>)
   command! -nargs=1 NvuiCursorEffectDuration call rpcnotify(g:nvui_rpc_chan, 'NVUI_CURSOR_EFFECT_DURATION', <args>)
+  command! -nargs=1 NvuiCursorBlinkIdle call rpcnotify(g:nvui_rpc_chan, 'NVUI_CURSOR_BLINK_IDLE', <args>)
   command! -nargs=1 NvuiPopupMenuInfoColumns call rpcnotify(g:nvui_rpc_chan, 'NVUI_PUM_INFO_COLS', <args>)
   command! -nargs=1 NvuiScrollAnimationDuration call rpcnotify(g:nvui_rpc_chan, 'NVUI_SCROLL_ANIMATION_DURATION', <args>)
   command! -nargs=1 NvuiSnapshotLimit call rpcnotify(g:nvui_rpc_chan, 'NVUI_SNAPSHOT_LIMIT', <args>)
@@ -661,9 +800,11 @@ void QtEditorUIBase::register_command_handlers()
   command! -nargs=1 NvuiPopupMenuBorderWidth call rpcnotify(g:nvui_rpc_chan, 'NVUI_PUM_BORDER_WIDTH', <args>)
   command! -nargs=1 NvuiPopupMenuMaxChars call rpcnotify(g:nvui_rpc_chan, 'NVUI_PUM_MAX_CHARS', <args>)
   command! -nargs=1 NvuiPopupMenuMaxItems call rpcnotify(g:nvui_rpc_chan, 'NVUI_PUM_MAX_ITEMS', <args>)
+  command! -nargs=1 NvuiPopupMenuFuzzy call rpcnotify(g:nvui_rpc_chan, 'NVUI_PUM_FUZZY', <args>)
   command! NvuiToggleFrameless call rpcnotify(g:nvui_rpc_chan, 'NVUI_TOGGLE_FRAMELESS')
   command! -nargs=1 NvuiOpacity call rpcnotify(g:nvui_rpc_chan, 'NVUI_WINOPACITY', <args>)
   command! -nargs=1 NvuiCharspace call rpcnotify(g:nvui_rpc_chan, 'NVUI_CHARSPACE', <args>)
+  command! -nargs=1 NvuiLigatures call rpcnotify(g:nvui_rpc_chan, 'NVUI_LIGATURES', <args>)
   command! -nargs=1 NvuiFullscreen call rpcnotify(g:nvui_rpc_chan, 'NVUI_FULLSCREEN', <args>)
   command! NvuiToggleFullscreen call rpcnotify(g:nvui_rpc_chan, 'NVUI_TOGGLE_FULLSCREEN')
   command! -nargs=1 NvuiFrameless call rpcnotify(g:nvui_rpc_chan, 'NVUI_FRAMELESS', <args>)
@@ -673,6 +814,7 @@ void QtEditorUIBase::register_command_handlers()
   command! -nargs=1 NvuiPopupMenu call rpcnotify(g:nvui_rpc_chan, 'NVUI_EXT_POPUPMENU', <args>)
   command! -nargs=1 NvuiCmdline call rpcnotify(g:nvui_rpc_chan, 'NVUI_EXT_CMDLINE', <args>)
   command! -nargs=1 NvuiSecondsBeforeIdle call rpcnotify(g:nvui_rpc_chan, 'NVUI_IDLE_WAIT_FOR', <args>)
+  command! -nargs=1 NvuiMouseWheelStep call rpcnotify(g:nvui_rpc_chan, 'NVUI_MOUSE_WHEEL_STEP', <args>)
   command! NvuiIMEEnable call rpcnotify(g:nvui_rpc_chan, 'NVUI_IME_SET', v:true)
   command! NvuiIMEDisable call rpcnotify(g:nvui_rpc_chan, 'NVUI_IME_SET', v:false)
   command! NvuiIMEToggle call rpcnotify(g:nvui_rpc_chan, 'NVUI_IME_TOGGLE')
@@ -681,6 +823,9 @@ void QtEditorUIBase::register_command_handlers()
   command! NvuiEditorPrev call rpcnotify(g:nvui_rpc_chan, 'NVUI_EDITOR_PREV')
   command! NvuiEditorNext call rpcnotify(g:nvui_rpc_chan, 'NVUI_EDITOR_NEXT')
   command! NvuiEditorSelect call rpcnotify(g:nvui_rpc_chan, 'NVUI_EDITOR_SELECT')
+  command! NvuiRenderStats echo rpcrequest(g:nvui_rpc_chan, 'NVUI_RENDER_STATS')
+  command! NvuiInputLatency echo rpcrequest(g:nvui_rpc_chan, 'NVUI_INPUT_LATENCY')
+  command! -nargs=1 -complete=file NvuiInputLatencyDump call rpcnotify(g:nvui_rpc_chan, 'NVUI_INPUT_LATENCY_DUMP', fnamemodify(expand(<q-args>), ':p'))
   function! NvuiGetTitle()
     return NvuiGet_title()
   endfunction
@@ -720,7 +865,6 @@ void QtEditorUIBase::do_close()
 
 void QtEditorUIBase::default_colors_changed(Color fg, Color bg)
 {
-  send_redraw();
   emit signaller.default_colors_changed(fg.qcolor(), bg.qcolor());
 }
 
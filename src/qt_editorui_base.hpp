@@ -6,6 +6,8 @@
 #include "scalers.hpp"
 #include "types.hpp"
 #include <QInputMethod>
+#include <map>
+#include <string>
 
 class QKeyEvent;
 class QInputMethodEvent;
@@ -78,6 +80,10 @@ public:
   float cursor_animation_duration() const;
   int cursor_animation_frametime() const;
   bool animations_enabled() const;
+  /// Whether grid text is shaped in clusters that start on their own
+  /// column (see :NvuiLigatures).
+  bool ligatures_enabled() const { return ligatures; }
+  void set_ligatures_enabled(bool enabled);
   u32 snapshot_limit() const;
   // Connect to the UI signaller to receieve
   // signals
@@ -88,6 +94,8 @@ public:
   std::string current_dir() const;
   // Returns the inheriting widget
   QWidget* widget();
+  /// Rendering statistics (name -> value), reported by :NvuiRenderStats.
+  virtual std::map<std::string, double> render_stats() const { return {}; }
 protected:
   bool idling() const;
   // Handling UI events.
@@ -95,6 +103,9 @@ protected:
   // and delegating key presses to other widgets,
   // that must be done by the widget's event handler
   void handle_key_press(QKeyEvent*);
+  /// Filter the popup menu by the typed key without waiting for
+  /// Neovim (see PopupMenu::set_fuzzy_enabled).
+  void filter_popup_menu(const QKeyEvent& event);
   QVariant handle_ime_query(Qt::InputMethodQuery);
   void handle_ime_event(QInputMethodEvent*);
   void handle_nvim_resize(QResizeEvent*);
@@ -111,7 +122,14 @@ protected:
     std::function<void (const ObjectArray&)> func
   );
   virtual void linespace_changed(float new_ls) = 0;
+  /// Called when only the cursor needs to be repainted
+  /// (blinking, cursor animations). Repaints the whole widget
+  /// by default.
+  virtual void update_cursor_area() { inheritor.update(); }
   virtual void charspace_changed(float new_cs) = 0;
+  /// Drags and wheel scrolls are sent to Neovim at most once per
+  /// interval. 16 ms by default.
+  virtual int frame_interval_ms() const { return 16; }
 private:
   void spawn_editor_with_params(const Object& params);
   void cursor_moved() override;
@@ -135,12 +153,30 @@ private:
    * matches the requirements.
    */
   std::optional<GridPos> grid_pos_for(QPoint pos) const;
+  /// grid_pos_for(), with grid 0 when multigrid is off.
+  std::optional<GridPos> mouse_grid_pos(QPoint pos) const;
+  /// Sends a press or release immediately (after what is pending).
   void send_mouse_input(
     QPoint pos,
     std::string btn,
     std::string action,
     std::string mods
   );
+  struct MouseInput
+  {
+    std::string button;
+    std::string action;
+    std::string mods;
+    GridPos pos;
+    int count = 1;
+  };
+  void send_mouse(const MouseInput& input);
+  /// Sends the pending drag and wheel input now if nothing was sent
+  /// during the current interval, otherwise when the interval ends.
+  void throttle_mouse_input();
+  /// Sends the pending drag and wheel input.
+  /// Returns whether anything was sent.
+  bool flush_mouse_input();
   void register_command_handlers();
   void idle();
   void un_idle();
@@ -175,6 +211,7 @@ protected:
   UIInformation ui_attach_info;
   bool animate = true;
   bool mousehide = false;
+  bool ligatures = false;
   float charspace = 0;
   float linespace = 0;
   u32 snapshot_count = 4;
@@ -185,6 +222,18 @@ protected:
   bool should_idle = false;
   std::optional<IdleState> idle_state;
   Mouse mouse;
+  /// Mouse input coalescing. Only the last drag position of an
+  /// interval is sent, and wheel steps are sent together.
+  QTimer mouse_timer;
+  std::optional<MouseInput> pending_drag;
+  std::optional<MouseInput> pending_wheel;
+  /// Angle delta that doesn't add up to a wheel step yet.
+  int wheel_delta = 0;
+  /// Angle delta per wheel step (120 is one notch of most mice).
+  /// 0 makes every wheel event a step.
+  int wheel_step = 120;
+  std::uint64_t mouse_events = 0;
+  std::uint64_t mouse_messages = 0;
   // This class is responsible for emitting signals
   // so that QtEditorUIBase doesn't have to inherit from QObject
   UISignaller signaller;
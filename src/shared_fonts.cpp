@@ -0,0 +1,117 @@
+#include "shared_fonts.hpp"
+#include <QHash>
+
+/// Keyed by the fonts (including their letter spacing).
+/// Entries expire when the last editor using them lets go.
+static QHash<QString, std::weak_ptr<SharedFonts>>& registry()
+{
+  static QHash<QString, std::weak_ptr<SharedFonts>> fonts;
+  return fonts;
+}
+
+static QString key_for(const std::vector<QFont>& font_list)
+{
+  QString key;
+  for(const auto& font : font_list)
+  {
+    // QFont::key() doesn't include the letter spacing
+    key += font.key() + QChar('|') + QString::number(font.letterSpacing());
+    key += QChar('\n');
+  }
+  return key;
+}
+
+/// Fallback indices, keyed by their fingerprint. The fingerprint doesn't
+/// depend on the font size or spacing, so the font sets of one guifont
+/// at different sizes all share an index.
+static QHash<QString, std::weak_ptr<FontFallbackIndex>>& index_registry()
+{
+  static QHash<QString, std::weak_ptr<FontFallbackIndex>> indices;
+  return indices;
+}
+
+/// The fallback index for the fonts, loaded from disk if no font set
+/// is using it yet. It is saved when the last font set using it is
+/// destroyed.
+static std::shared_ptr<FontFallbackIndex> shared_index(
+  const std::vector<Font>& fonts
+)
+{
+  auto& indices = index_registry();
+  auto key = FontFallbackIndex::fingerprint(fonts);
+  if (auto it = indices.find(key); it != indices.end())
+  {
+    if (auto existing = it->lock()) return existing;
+  }
+  for(auto it = indices.begin(); it != indices.end();)
+  {
+    if (it->expired()) it = indices.erase(it);
+    else ++it;
+  }
+  auto* index = new FontFallbackIndex();
+  index->reset(key);
+  index->load(FontFallbackIndex::default_dir(), fonts.size());
+  std::shared_ptr<FontFallbackIndex> shared {index, [](FontFallbackIndex* idx) {
+    if (idx->dirty()) idx->save(FontFallbackIndex::default_dir());
+    delete idx;
+  }};
+  indices.insert(std::move(key), shared);
+  return shared;
+}
+
+SharedFonts::SharedFonts(std::vector<QFont> font_list)
+{
+  fonts.reserve(font_list.size());
+  for(auto& font : font_list) fonts.emplace_back(font);
+  fallback_index = shared_index(fonts);
+}
+
+std::shared_ptr<SharedFonts> SharedFonts::acquire(std::vector<QFont> font_list)
+{
+  auto& fonts = registry();
+  auto key = key_for(font_list);
+  if (auto it = fonts.find(key); it != fonts.end())
+  {
+    if (auto existing = it->lock()) return existing;
+  }
+  // Drop the entries of font sets nobody uses anymore
+  for(auto it = fonts.begin(); it != fonts.end();)
+  {
+    if (it->expired()) it = fonts.erase(it);
+    else ++it;
+  }
+  auto shared = std::make_shared<SharedFonts>(std::move(font_list));
+  fonts.insert(std::move(key), shared);
+  return shared;
+}
+
+std::size_t SharedFonts::live_count()
+{
+  std::size_t count = 0;
+  const auto& fonts = registry();
+  for(const auto& entry : fonts)
+  {
+    if (!entry.expired()) ++count;
+  }
+  return count;
+}
+
+/// A copy of font that doesn't share its private data with it.
+/// Copying a QFont only shares the data, but resolve() detaches it
+/// (the attributes that aren't set come from the default font, as they
+/// do when the font is drawn with).
+static QFont unshared(const QFont& font)
+{
+  return font.resolve(QFont());
+}
+
+void SharedFonts::reserve_band_caches(std::size_t n)
+{
+  while(band_caches.size() < n)
+  {
+    band_caches.push_back(std::make_unique<GridCaches>());
+    auto& copies = band_fonts.emplace_back();
+    copies.reserve(fonts.size());
+    for(const auto& font : fonts) copies.emplace_back(unshared(font.font()));
+  }
+}
@@ -0,0 +1,140 @@
+#ifndef NVUI_SHARED_FONTS_HPP
+#define NVUI_SHARED_FONTS_HPP
+
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QPair>
+#include <QStaticText>
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "font.hpp"
+#include "font_fallback.hpp"
+#include "hlstate.hpp"
+#include "lru.hpp"
+#include "utils.hpp"
+
+/// Rough estimate of the memory held by a cached QStaticText:
+/// the text itself plus its prepared glyphs and positions.
+struct StaticTextSize
+{
+  std::size_t operator()(
+    const QPair<QString, FontOptions>& key,
+    const QStaticText&
+  ) const
+  {
+    return sizeof(key) + sizeof(QStaticText) + static_text_bytes(key.first);
+  }
+};
+
+/// Shaped grid text, keyed by the text and its font options.
+using TextCache = LRUCache<
+  QPair<QString, FontOptions>,
+  QStaticText,
+  do_nothing_deleter<QStaticText>,
+  StaticTextSize
+>;
+
+/// A rasterized run of text, for drawing text at fractional positions.
+/// x positions are quantized to one of subpixel_buckets offsets
+/// within a pixel, and each offset is rasterized once. Rasters are opaque
+/// (filled with the run's background) so text keeps subpixel antialiasing.
+struct GlyphRasterKey
+{
+  QString text;
+  FontOptions font_opts = FontOpts::Normal;
+  /// Fonts are owned by the SharedFonts the cache belongs to,
+  /// so they outlive the cache entries.
+  const QFont* font = nullptr;
+  std::uint32_t fg = 0;
+  std::uint32_t bg = 0;
+  /// Width of the raster in pixels.
+  std::uint16_t width = 0;
+  std::uint8_t bucket = 0;
+  bool operator==(const GlyphRasterKey&) const = default;
+};
+
+inline std::size_t qHash(const GlyphRasterKey& key, std::size_t seed = 0)
+{
+  return qHash(key.text, uint(seed))
+    ^ qHash(quintptr(key.font))
+    ^ qHash((quint64(key.fg) << 24) | (quint64(key.font_opts) << 8) | key.bucket)
+    ^ qHash((quint64(key.bg) << 16) | key.width);
+}
+
+struct GlyphRasterSize
+{
+  std::size_t operator()(const GlyphRasterKey& key, const QImage& image) const
+  {
+    return sizeof(key) + static_text_bytes(key.text)
+      + std::size_t(image.sizeInBytes());
+  }
+};
+
+using GlyphRasterCache = LRUCache<
+  GlyphRasterKey,
+  QImage,
+  do_nothing_deleter<QImage>,
+  GlyphRasterSize
+>;
+
+/// The caches a single thread draws grid text with.
+struct GridCaches
+{
+  static constexpr std::size_t text_cache_size = 2000;
+  static constexpr std::size_t text_cache_bytes = 8 * 1024 * 1024;
+  static constexpr std::size_t raster_cache_size = 4000;
+  static constexpr std::size_t raster_cache_bytes = 8 * 1024 * 1024;
+  GridCaches()
+    : text(text_cache_size, text_cache_bytes),
+      rasters(raster_cache_size, raster_cache_bytes)
+  {
+  }
+  TextCache text;
+  GlyphRasterCache rasters;
+};
+
+/// The fallback fonts and everything derived from them (fallback
+/// lookups and shaped text), shared by every editor in the process
+/// that uses the same fonts with the same character spacing.
+/// Editors hold on to it through a shared_ptr, so a newly spawned editor
+/// with the same guifont starts out with warm caches, and it's destroyed
+/// when the last editor using it lets go. The fallback index outlives
+/// it while other sizes of the same fonts are in use, and is saved
+/// when the last of them is destroyed.
+/// Only used from the GUI thread, except for the band caches which
+/// QPaintGrid::draw_all() hands out to one worker each.
+class SharedFonts
+{
+public:
+  explicit SharedFonts(std::vector<QFont> font_list);
+  SharedFonts(const SharedFonts&) = delete;
+  SharedFonts& operator=(const SharedFonts&) = delete;
+  /**
+   * Returns the shared fonts for the given fallback list, creating
+   * them if no editor is using that list yet.
+   */
+  static std::shared_ptr<SharedFonts> acquire(std::vector<QFont> font_list);
+  /// Number of distinct font sets currently in use.
+  static std::size_t live_count();
+  /// Make sure there are at least n band caches (and band fonts).
+  void reserve_band_caches(std::size_t n);
+  std::vector<Font> fonts;
+  /// Shared with the other font sets of the same fonts at other sizes
+  /// or spacings (e.g. while zooming), so they all learn and save into
+  /// the same index.
+  std::shared_ptr<FontFallbackIndex> fallback_index;
+  GridCaches caches;
+  /// Caches for the worker threads in QPaintGrid::draw_all().
+  /// Grids are drawn one at a time, so sharing these is safe.
+  std::vector<std::unique_ptr<GridCaches>> band_caches;
+  /// Each band's own copy of the fonts. QFont is reentrant but not
+  /// thread-safe (it caches its font engines per thread in data that
+  /// copies share), so workers never use 'fonts'.
+  std::vector<std::vector<Font>> band_fonts;
+};
+
+#endif // NVUI_SHARED_FONTS_HPP
@@ -0,0 +1,75 @@
+#ifndef NVUI_STATS_HPP
+#define NVUI_STATS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+/// Keeps the most recent samples of a measurement (e.g. frame times
+/// or input latency, in milliseconds) and computes percentiles over them.
+/// Once the capacity is reached the oldest sample is overwritten.
+class RollingSamples
+{
+public:
+  RollingSamples(std::size_t capacity = 256)
+    : max_size(std::max<std::size_t>(capacity, 1))
+  {
+    samples.reserve(max_size);
+  }
+  void add(double value)
+  {
+    if (samples.size() < max_size) samples.push_back(value);
+    else samples[next] = value;
+    next = (next + 1) % max_size;
+    ++total;
+  }
+  /// Number of samples currently kept.
+  std::size_t size() const { return samples.size(); }
+  /// Number of samples ever added.
+  std::size_t count() const { return total; }
+  bool empty() const { return samples.empty(); }
+  void clear()
+  {
+    samples.clear();
+    next = 0;
+    total = 0;
+  }
+  /// The most recently added sample (0 if there are none).
+  double last() const
+  {
+    if (samples.empty()) return 0.;
+    return samples[(next + max_size - 1) % max_size];
+  }
+  /// The sample at the given percentile (0-100) using the
+  /// nearest-rank method, or 0 if there are no samples.
+  double percentile(double pct) const
+  {
+    if (samples.empty()) return 0.;
+    std::vector<double> sorted = samples;
+    pct = std::clamp(pct, 0., 100.);
+    auto idx = static_cast<std::size_t>(pct / 100. * double(sorted.size() - 1) + 0.5);
+    std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+    return sorted[idx];
+  }
+  /// Counts the samples in each bucket delimited by the (ascending)
+  /// upper bounds. The last bucket holds the samples above every bound,
+  /// so there is one more bucket than there are bounds.
+  std::vector<std::size_t> histogram(std::span<const double> bounds) const
+  {
+    std::vector<std::size_t> counts(bounds.size() + 1, 0);
+    for(double sample : samples)
+    {
+      auto it = std::lower_bound(bounds.begin(), bounds.end(), sample);
+      ++counts[static_cast<std::size_t>(it - bounds.begin())];
+    }
+    return counts;
+  }
+private:
+  std::size_t max_size;
+  std::vector<double> samples;
+  std::size_t next = 0;
+  std::size_t total = 0;
+};
+
+#endif // NVUI_STATS_HPP
@@ -192,4 +192,14 @@ inline void reverse_qstring(QString& s)
   }
 }
 
+/// Rough estimate of the memory held by a prepared QStaticText
+/// for the given text, used for cache memory accounting.
+/// Counts the text and, per character, its glyph and position data.
+inline std::size_t static_text_bytes(const QString& text)
+{
+  constexpr std::size_t overhead = 256;
+  constexpr std::size_t per_char = 40;
+  return overhead + std::size_t(text.size()) * per_char;
+}
+
 #endif // NVUI_UTILS_HPP
@@ -0,0 +1,66 @@
+#include <catch2/catch.hpp>
+#include <QTemporaryDir>
+#include "font_fallback.hpp"
+
+TEST_CASE("FontFallbackIndex stores BMP and astral codepoints", "[font_fallback]")
+{
+  FontFallbackIndex index;
+  REQUIRE_FALSE(index.find(0x4E00));
+  index.set(0x4E00, 2); // CJK
+  index.set(0x1F600, 3); // Emoji
+  REQUIRE(index.find(0x4E00) == 2u);
+  REQUIRE(index.find(0x1F600) == 3u);
+  REQUIRE(index.size() == 2);
+  index.set(0x4E00, 1);
+  REQUIRE(index.find(0x4E00) == 1u);
+  REQUIRE(index.size() == 2);
+  index.reset("other fonts");
+  REQUIRE(index.size() == 0);
+  REQUIRE_FALSE(index.find(0x4E00));
+  REQUIRE_FALSE(index.find(0x1F600));
+}
+
+TEST_CASE("FontFallbackIndex round-trips through disk", "[font_fallback]")
+{
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+  FontFallbackIndex index;
+  index.reset("Font A/Regular/abc;Font B/Regular/def;");
+  index.set(0x4E00, 1);
+  index.set(0x1F600, 0);
+  REQUIRE(index.dirty());
+  REQUIRE(index.save(dir.path()));
+  REQUIRE_FALSE(index.dirty());
+
+  FontFallbackIndex loaded;
+  loaded.reset("Font A/Regular/abc;Font B/Regular/def;");
+  REQUIRE(loaded.load(dir.path(), 2));
+  REQUIRE(loaded.size() == 2);
+  REQUIRE(loaded.find(0x4E00) == 1u);
+  REQUIRE(loaded.find(0x1F600) == 0u);
+
+  FontFallbackIndex different;
+  different.reset("Font C/Regular/123;");
+  REQUIRE_FALSE(different.load(dir.path(), 1));
+  REQUIRE(different.size() == 0);
+}
+
+TEST_CASE("FontFallbackIndex rejects fonts past the fallback list", "[font_fallback]")
+{
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+  FontFallbackIndex index;
+  index.reset("Font A/Regular/abc;Font B/Regular/def;");
+  index.set(0x4E00, 1);
+  // Only valid for a longer fallback list
+  index.set(0x1F600, 5);
+  REQUIRE(index.save(dir.path()));
+
+  FontFallbackIndex loaded;
+  loaded.reset("Font A/Regular/abc;Font B/Regular/def;");
+  REQUIRE_FALSE(loaded.load(dir.path(), 2));
+  REQUIRE(loaded.size() == 0);
+  REQUIRE_FALSE(loaded.find(0x4E00));
+  REQUIRE_FALSE(loaded.find(0x1F600));
+  REQUIRE(loaded.key() == "Font A/Regular/abc;Font B/Regular/def;");
+}
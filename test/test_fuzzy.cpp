@@ -0,0 +1,54 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "fuzzy.hpp"
+
+static std::vector<std::string> matched_words(
+  const FuzzyIndex& index,
+  std::string_view query
+)
+{
+  std::vector<std::string> words;
+  for(const auto& match : index.filter(query))
+  {
+    words.emplace_back(index.word(match.index));
+  }
+  return words;
+}
+
+TEST_CASE("FuzzyIndex matches subsequences ignoring case", "[fuzzy]")
+{
+  FuzzyIndex index;
+  for(const auto* w : {"set_text", "SetText", "reset", "stxt", "other"})
+  {
+    index.add(w);
+  }
+  REQUIRE(index.size() == 5);
+  REQUIRE(index.word(1) == "SetText");
+  const auto words = matched_words(index, "stxt");
+  REQUIRE(words.size() == 3);
+  REQUIRE(std::find(words.begin(), words.end(), "reset") == words.end());
+  REQUIRE(std::find(words.begin(), words.end(), "other") == words.end());
+  REQUIRE(matched_words(index, "zz").empty());
+  // An empty query keeps every word, in order
+  REQUIRE(matched_words(index, "") == std::vector<std::string> {
+    "set_text", "SetText", "reset", "stxt", "other"
+  });
+}
+
+TEST_CASE("FuzzyIndex ranks prefix and word part matches first", "[fuzzy]")
+{
+  FuzzyIndex index;
+  for(const auto* w : {"xaybzc", "abc_def", "a_b_c", "abc"}) index.add(w);
+  const auto words = matched_words(index, "abc");
+  REQUIRE(words.size() == 4);
+  REQUIRE(words[0] == "abc");
+  REQUIRE(words[1] == "abc_def");
+  REQUIRE(words[2] == "a_b_c");
+  REQUIRE(words[3] == "xaybzc");
+  // camelCase humps count as word parts
+  index.clear();
+  for(const auto* w : {"xfxb", "fooBar"}) index.add(w);
+  REQUIRE(matched_words(index, "fb").front() == "fooBar");
+}
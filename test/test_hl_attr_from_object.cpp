@@ -30,5 +30,34 @@ TEST_CASE("hl_attr_from_object works", "[hl_attr_from_object]")
     REQUIRE(!resulting_attr.bg().has_value());
     REQUIRE(resulting_attr.fg().has_value());
     REQUIRE(resulting_attr.fg().value().to_uint32() == rgb);
+    REQUIRE(resulting_attr.italic());
+    std::vector<AttrState> states;
+    hl::hl_attr_from_object(o, &states);
+    REQUIRE(states.size() == 1);
+    REQUIRE(states[0].hi_name == "TSParameter");
+    REQUIRE(states[0].kind == Kind::Syntax);
+    REQUIRE(states[0].id == 107);
+  }
+}
+
+TEST_CASE("HLState resolves colours against the defaults", "[hlstate]")
+{
+  HLState state;
+  state.default_colors_set(ObjectArray {uint64(0xffffff), uint64(0), uint64(0xff0000)});
+  state.define(ObjectArray {
+    uint64(1),
+    ObjectMap {{"foreground", uint64(0x00ff00)}, {"reverse", true}},
+    ObjectMap {},
+    ObjectArray {}
+  });
+  REQUIRE(state.resolved(1).fg == 0);
+  REQUIRE(state.resolved(1).bg == 0x00ff00);
+  REQUIRE(state.resolved(1).sp == 0);
+  REQUIRE(state.resolved(2).bg == 0);
+  SECTION("Changing the default colours updates the resolved table")
+  {
+    state.default_colors_set(ObjectArray {uint64(0xffffff), uint64(0x123456), uint64(0)});
+    REQUIRE(state.resolved(1).fg == 0x123456);
+    REQUIRE(state.resolved(2).bg == 0x123456);
   }
 }
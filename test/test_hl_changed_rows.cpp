@@ -0,0 +1,88 @@
+#include <catch2/catch.hpp>
+#include <vector>
+#include "grid.hpp"
+#include "hlstate.hpp"
+#include "object.hpp"
+
+static Object hl_define(int id, std::uint32_t fg)
+{
+  return ObjectArray {
+    uint64(id),
+    ObjectMap {{"foreground", uint64(fg)}},
+    ObjectMap {},
+    ObjectArray {}
+  };
+}
+
+/// The rows of the draw events in the grid's queue, in order.
+static std::vector<QRect> queued_draws(GridBase& grid)
+{
+  std::vector<QRect> rects;
+  for(; !grid.evt_q.empty(); grid.evt_q.pop())
+  {
+    const auto& evt = grid.evt_q.front();
+    if (evt.is_draw_event()) rects.push_back(evt.draw_info().rect);
+  }
+  return rects;
+}
+
+TEST_CASE("HLState reports only redefined ids", "[hl_changes]")
+{
+  HLState hl_state;
+  // No cell can use an id before it's defined
+  hl_state.define(hl_define(1, 0xFF0000));
+  hl_state.define(hl_define(2, 0x00FF00));
+  hl_state.define(hl_define(300, 0x00FF00));
+  REQUIRE(hl_state.take_changed_ids().empty());
+  // Same attributes, nothing to redraw
+  hl_state.define(hl_define(1, 0xFF0000));
+  REQUIRE(hl_state.take_changed_ids().empty());
+  hl_state.define(hl_define(2, 0x0000FF));
+  REQUIRE(hl_state.take_changed_ids() == std::vector<int> {2});
+  REQUIRE(hl_state.take_changed_ids().empty());
+}
+
+TEST_CASE("Grids only redraw the rows using changed ids", "[hl_changes]")
+{
+  GridBase grid {0, 0, 4, 4, 1};
+  grid.set_text(" ", 0, 0, 1, 4, false);
+  grid.set_text(" ", 1, 0, 2, 4, false);
+  grid.set_text(" ", 2, 0, 2, 2, false);
+  grid.set_text(" ", 3, 0, 1, 4, false);
+  grid.clear_event_queue();
+  const int changed[] {2};
+  grid.send_draw_for_hl_ids(changed);
+  // Rows 1 and 2 are sent as one draw
+  REQUIRE(queued_draws(grid) == std::vector<QRect> {QRect(0, 1, 4, 2)});
+  // Rows that changed since are picked up
+  grid.set_text(" ", 3, 0, 2, 1, false);
+  grid.send_draw_for_hl_ids(changed);
+  REQUIRE(queued_draws(grid) == std::vector<QRect> {
+    QRect(0, 1, 4, 3)
+  });
+  const int unused[] {7};
+  grid.send_draw_for_hl_ids(unused);
+  REQUIRE(grid.evt_q.empty());
+}
+
+TEST_CASE("Defining new ids queues no draws", "[hl_changes]")
+{
+  HLState hl_state;
+  GridBase grid {0, 0, 4, 2, 1};
+  grid.set_text(" ", 0, 0, 0, 4, false);
+  grid.clear_event_queue();
+  for(int id = 1; id < 400; ++id) hl_state.define(hl_define(id, 0xFF0000));
+  grid.send_draw_for_hl_ids(hl_state.take_changed_ids());
+  REQUIRE(grid.evt_q.empty());
+}
+
+TEST_CASE("Grids track ids past 255 per row", "[hl_changes]")
+{
+  GridBase grid {0, 0, 4, 3, 1};
+  grid.set_text(" ", 1, 0, 300, 4, false);
+  grid.set_text(" ", 2, 0, 1000, 4, false);
+  grid.clear_event_queue();
+  const int changed[] {3, 300};
+  grid.send_draw_for_hl_ids(changed);
+  REQUIRE(queued_draws(grid) == std::vector<QRect> {QRect(0, 1, 4, 1)});
+}
@@ -0,0 +1,50 @@
+#include <catch2/catch.hpp>
+#include "input_latency.hpp"
+
+using namespace std::chrono_literals;
+using clock_type = InputLatency::clock;
+
+TEST_CASE("InputLatency times each stage of a key press", "[input_latency]")
+{
+  InputLatency latency;
+  const auto t = clock_type::time_point {} + 10s;
+  latency.key_pressed(t);
+  latency.input_written(t + 1ms);
+  // Read before the input was written, not an answer to it
+  latency.redraw_received(t + 500us);
+  latency.redraw_received(t + 5ms);
+  latency.flushed(t + 6ms);
+  // A second key before the frame is painted is folded into the first
+  latency.key_pressed(t + 7ms);
+  REQUIRE(latency.painted(t + 10ms));
+  REQUIRE(latency.folded_keys() == 1);
+  REQUIRE(latency.samples(InputLatency::Write).last() == Approx(1.));
+  REQUIRE(latency.samples(InputLatency::Nvim).last() == Approx(4.));
+  REQUIRE(latency.samples(InputLatency::Process).last() == Approx(1.));
+  REQUIRE(latency.samples(InputLatency::Paint).last() == Approx(4.));
+  REQUIRE(latency.samples(InputLatency::Total).last() == Approx(10.));
+  // Nothing left to paint
+  REQUIRE_FALSE(latency.painted(t + 20ms));
+  REQUIRE(latency.csv() ==
+    "write,nvim,process,paint,total\n"
+    "1.000,4.000,1.000,4.000,10.000\n"
+  );
+}
+
+TEST_CASE("InputLatency drops key presses that never redrew", "[input_latency]")
+{
+  InputLatency latency;
+  const auto t = clock_type::time_point {} + 10s;
+  latency.key_pressed(t);
+  latency.input_written(t + 1ms);
+  // Paints without a flush for the key don't complete it
+  REQUIRE_FALSE(latency.painted(t + 2ms));
+  latency.key_pressed(t + 2s);
+  REQUIRE(latency.dropped_keys() == 1);
+  REQUIRE(latency.folded_keys() == 0);
+  latency.input_written(t + 2s + 1ms);
+  latency.redraw_received(t + 2s + 2ms);
+  latency.flushed(t + 2s + 2ms);
+  REQUIRE(latency.painted(t + 2s + 3ms));
+  REQUIRE(latency.samples(InputLatency::Total).last() == Approx(3.));
+}
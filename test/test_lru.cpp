@@ -0,0 +1,72 @@
+#include <catch2/catch.hpp>
+#include <QString>
+#include "lru.hpp"
+
+TEST_CASE("LRUCache evicts the least recently used entry", "[lru]")
+{
+  LRUCache<QString, int> cache {3};
+  cache.put("a", 1);
+  cache.put("b", 2);
+  cache.put("c", 3);
+  // "a" is now the most recently used
+  REQUIRE(cache.get("a"));
+  cache.put("d", 4);
+  REQUIRE(cache.size() == 3);
+  REQUIRE_FALSE(cache.get("b"));
+  REQUIRE(*cache.get("a") == 1);
+  REQUIRE(*cache.get("c") == 3);
+  REQUIRE(*cache.get("d") == 4);
+  REQUIRE(cache.stats().evictions == 1);
+  REQUIRE(cache.stats().misses == 1);
+  REQUIRE(cache.stats().hits == 4);
+}
+
+TEST_CASE("LRUCache replaces existing values", "[lru]")
+{
+  LRUCache<QString, int> cache {2};
+  cache.put("a", 1);
+  cache.put("a", 2);
+  REQUIRE(cache.size() == 1);
+  REQUIRE(*cache.get("a") == 2);
+  cache.clear();
+  REQUIRE(cache.size() == 0);
+  REQUIRE_FALSE(cache.get("a"));
+}
+
+struct StringLength
+{
+  std::size_t operator()(const int&, const QString& s) const
+  {
+    return std::size_t(s.size());
+  }
+};
+
+TEST_CASE("LRUCache respects the byte budget", "[lru]")
+{
+  LRUCache<int, QString, do_nothing_deleter<QString>, StringLength> cache {
+    100, 10
+  };
+  cache.put(1, "aaaa");
+  cache.put(2, "bbbb");
+  REQUIRE(cache.bytes() == 8);
+  cache.put(3, "cccc");
+  // Over budget, 1 has to go
+  REQUIRE(cache.bytes() == 8);
+  REQUIRE_FALSE(cache.get(1));
+  REQUIRE(cache.get(2));
+  // An entry bigger than the budget is still kept (alone)
+  cache.put(4, "dddddddddddddddd");
+  REQUIRE(cache.size() == 1);
+  REQUIRE(cache.get(4));
+  REQUIRE(cache.stats().evictions == 3);
+}
+
+TEST_CASE("LRUCache entries don't move as the cache grows", "[lru]")
+{
+  LRUCache<int, int> cache {1000};
+  const int* first = &cache.put(0, 42);
+  for(int i = 1; i < 1000; ++i) cache.put(i, i);
+  REQUIRE(cache.size() == 1000);
+  REQUIRE(cache.get(0) == first);
+  REQUIRE(*first == 42);
+}
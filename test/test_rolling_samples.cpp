@@ -0,0 +1,40 @@
+#include <catch2/catch.hpp>
+#include "stats.hpp"
+
+TEST_CASE("RollingSamples computes percentiles", "[stats]")
+{
+  RollingSamples samples {100};
+  REQUIRE(samples.empty());
+  REQUIRE(samples.percentile(50) == 0.);
+  for(int i = 1; i <= 100; ++i) samples.add(i);
+  REQUIRE(samples.size() == 100);
+  REQUIRE(samples.last() == 100.);
+  REQUIRE(samples.percentile(0) == 1.);
+  REQUIRE(samples.percentile(50) == 51.);
+  REQUIRE(samples.percentile(99) == 99.);
+  REQUIRE(samples.percentile(100) == 100.);
+}
+
+TEST_CASE("RollingSamples overwrites the oldest samples", "[stats]")
+{
+  RollingSamples samples {4};
+  for(int i = 1; i <= 6; ++i) samples.add(i);
+  REQUIRE(samples.size() == 4);
+  REQUIRE(samples.count() == 6);
+  REQUIRE(samples.last() == 6.);
+  // Samples 1 and 2 were overwritten
+  REQUIRE(samples.percentile(0) == 3.);
+  REQUIRE(samples.percentile(100) == 6.);
+  samples.clear();
+  REQUIRE(samples.empty());
+  REQUIRE(samples.last() == 0.);
+}
+
+TEST_CASE("RollingSamples buckets samples into a histogram", "[stats]")
+{
+  RollingSamples samples {10};
+  for(double d : {0.5, 1., 1.5, 3., 20.}) samples.add(d);
+  const double bounds[] {1., 2., 4.};
+  const auto counts = samples.histogram(bounds);
+  REQUIRE(counts == std::vector<std::size_t> {2, 1, 1, 1});
+}